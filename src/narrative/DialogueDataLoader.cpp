@@ -65,6 +65,37 @@ SpeakerSocialRole DialogueDataLoader::ParseRole(const std::string& s)
     return SpeakerSocialRole::Villager;
 }
 
+bool DialogueDataLoader::ParseTriggerInput(const std::string& s, TriggerRule::Input& out)
+{
+    // Field names as in NPCVoiceProfile / DialogueContext, in Input order.
+    static const char* const kInputNames[kTriggerInputCount] = {
+        "verbosity01", "superstition01", "bureaucratic01", "religiosity01",
+        "cruelty01", "unreliability01", "fatalism01", "threatlevel01",
+        "isindoors", "isnight", "playerrecentlybroketaboo", "playerlowhealth",
+        "playerisbleeding", "insaferoomflagged", "knownrumorcount", "always"
+    };
+
+    const std::string v = ToLower(s);
+    for (size_t i = 0; i < kTriggerInputCount; ++i)
+    {
+        if (v == kInputNames[i])
+        {
+            out = static_cast<TriggerRule::Input>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DialogueDataLoader::ParseTriggerCompare(const std::string& s, TriggerRule::Compare& out)
+{
+    if (s == ">")  { out = TriggerRule::Compare::Greater;      return true; }
+    if (s == ">=") { out = TriggerRule::Compare::GreaterEqual; return true; }
+    if (s == "<")  { out = TriggerRule::Compare::Less;         return true; }
+    if (s == "<=") { out = TriggerRule::Compare::LessEqual;    return true; }
+    return false;
+}
+
 // Very strict external IP guard.
 // In practice, back this with your IDEGenerationGuardrails blacklist. [file:1]
 bool DialogueDataLoader::ContainsForbiddenIPTokens(const std::string& text)
@@ -225,13 +256,13 @@ bool DialogueDataLoader::LoadDialogueUnitsFromFile(const std::string& path,
         if (requiresNight || requiresPlayerBleed || minThreat >= 0.0)
         {
             t.condition = [requiresNight, requiresPlayerBleed, minThreat]
-                          (const DialogueContext& ctx, const NPCVoiceProfile&)
+                          (const DialogueConditionContext& c)
             {
-                if (requiresNight && !ctx.isNight)
+                if (requiresNight && !c.ctx.Has(PackedDialogueContext::Night))
                     return false;
-                if (requiresPlayerBleed && !ctx.playerIsBleeding)
+                if (requiresPlayerBleed && !c.ctx.Has(PackedDialogueContext::PlayerIsBleeding))
                     return false;
-                if (minThreat >= 0.0 && ctx.threatLevel01 < static_cast<float>(minThreat))
+                if (minThreat >= 0.0 && !c.ctx.ThreatAtLeast(static_cast<float>(minThreat)))
                     return false;
                 return true;
             };
@@ -245,3 +276,182 @@ bool DialogueDataLoader::LoadDialogueUnitsFromFile(const std::string& path,
 
     return true;
 }
+
+bool DialogueDataLoader::LoadArchetypesFromFile(const std::string& path,
+                                                DialogueSystem& outSystem,
+                                                std::vector<std::string>& outWarnings)
+{
+    std::ifstream in(path.c_str());
+    if (!in.is_open())
+    {
+        outWarnings.push_back("DialogueDataLoader: Failed to open file '" + path + "'");
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string content = buffer.str();
+    in.close();
+
+    JsonLite::Value root;
+    if (!JsonLite::Parse(content, root) || !root.IsArray())
+    {
+        outWarnings.push_back("DialogueDataLoader: File '" + path +
+                              "' is not a valid archetype array JSON.");
+        return false;
+    }
+
+    // Keys accepted in "cooldownSeconds", in DialogueFunction order; the
+    // all-lowercase spelling is accepted too.
+    static const char* const kFunctionNames[kDialogueFunctionCount] = {
+        "NeutralAmbient", "Dread", "Misdirection", "RitualHint", "Rumor",
+        "Bureaucratic", "ThreatBark", "Pain", "Surprise"
+    };
+
+    for (size_t i = 0; i < root.Size(); ++i)
+    {
+        const JsonLite::Value& node = root[i];
+        if (!node.IsObject())
+            continue;
+
+        const std::string id = node.GetString("id", "");
+        if (id.empty())
+        {
+            outWarnings.push_back("DialogueDataLoader: Skipping archetype with missing id in '" + path + "'");
+            continue;
+        }
+
+        NPCVoiceProfile voice;
+        voice.role            = ParseRole(node.GetString("role", "Villager"));
+        voice.verbosity01     = static_cast<float>(node.GetNumber("verbosity01", voice.verbosity01));
+        voice.superstition01  = static_cast<float>(node.GetNumber("superstition01", voice.superstition01));
+        voice.bureaucratic01  = static_cast<float>(node.GetNumber("bureaucratic01", voice.bureaucratic01));
+        voice.religiosity01   = static_cast<float>(node.GetNumber("religiosity01", voice.religiosity01));
+        voice.cruelty01       = static_cast<float>(node.GetNumber("cruelty01", voice.cruelty01));
+        voice.unreliability01 = static_cast<float>(node.GetNumber("unreliability01", voice.unreliability01));
+        voice.fatalism01      = static_cast<float>(node.GetNumber("fatalism01", voice.fatalism01));
+        voice.dialectTag      = node.GetString("dialectTag", "");
+
+        if (node.HasMember("personalMotifs") && node["personalMotifs"].IsArray())
+        {
+            const JsonLite::Value& arr = node["personalMotifs"];
+            for (size_t j = 0; j < arr.Size(); ++j)
+            {
+                const std::string s = arr[j].GetString("", "");
+                if (!s.empty())
+                    voice.personalMotifs.push_back(s);
+            }
+        }
+
+        if (node.HasMember("cooldownSeconds") && node["cooldownSeconds"].IsObject())
+        {
+            const JsonLite::Value& cds = node["cooldownSeconds"];
+            size_t matched = 0;
+            for (size_t f = 0; f < kDialogueFunctionCount; ++f)
+            {
+                const std::string lower = ToLower(kFunctionNames[f]);
+                const char* key = cds.HasMember(kFunctionNames[f]) ? kFunctionNames[f]
+                                : cds.HasMember(lower.c_str()) ? lower.c_str() : nullptr;
+                if (!key)
+                    continue;
+                voice.cooldownSeconds[f] = static_cast<float>(cds.GetNumber(key, voice.cooldownSeconds[f]));
+                ++matched;
+            }
+
+            if (matched < cds.Size())
+            {
+                outWarnings.push_back("DialogueDataLoader: Archetype '" + id + "' has " +
+                                      std::to_string(cds.Size() - matched) +
+                                      " cooldownSeconds key(s) that are not function names.");
+            }
+        }
+
+        outSystem.RegisterArchetype(id, voice);
+    }
+
+    return true;
+}
+
+bool DialogueDataLoader::LoadTriggerRulesFromFile(const std::string& path,
+                                                  DialogueSystem& outSystem,
+                                                  std::vector<std::string>& outWarnings)
+{
+    std::ifstream in(path.c_str());
+    if (!in.is_open())
+    {
+        outWarnings.push_back("DialogueDataLoader: Failed to open file '" + path + "'");
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string content = buffer.str();
+    in.close();
+
+    JsonLite::Value root;
+    if (!JsonLite::Parse(content, root) || !root.IsArray())
+    {
+        outWarnings.push_back("DialogueDataLoader: File '" + path +
+                              "' is not a valid trigger rule array JSON.");
+        return false;
+    }
+
+    for (size_t i = 0; i < root.Size(); ++i)
+    {
+        const JsonLite::Value& node = root[i];
+        if (!node.IsObject())
+            continue;
+
+        // "" is the unknown-trigger fallback, so it has to be named on purpose.
+        if (!node.HasMember("trigger"))
+        {
+            outWarnings.push_back("DialogueDataLoader: Skipping rules entry with missing trigger in '" + path + "'");
+            continue;
+        }
+
+        const std::string trigger = node.GetString("trigger", "");
+        if (!node.HasMember("rules") || !node["rules"].IsArray())
+        {
+            outWarnings.push_back("DialogueDataLoader: Skipping trigger '" + trigger +
+                                  "' with missing rules array in '" + path + "'");
+            continue;
+        }
+
+        std::vector<TriggerRule> rules;
+        bool valid = true;
+        const JsonLite::Value& arr = node["rules"];
+        for (size_t j = 0; j < arr.Size() && valid; ++j)
+        {
+            const JsonLite::Value& ruleNode = arr[j];
+            if (!ruleNode.IsObject())
+            {
+                outWarnings.push_back("DialogueDataLoader: Trigger '" + trigger +
+                                      "' has a rule that is not an object (index " + std::to_string(j) + ").");
+                valid = false;
+                continue;
+            }
+
+            TriggerRule rule;
+            rule.function = ParseFunction(ruleNode.GetString("function", "NeutralAmbient"));
+            rule.threshold = static_cast<float>(ruleNode.GetNumber("value", 0.0));
+
+            const std::string when = ruleNode.GetString("when", "always");
+            const std::string op = ruleNode.GetString("op", ">");
+            if (!ParseTriggerInput(when, rule.input) || !ParseTriggerCompare(op, rule.compare))
+            {
+                outWarnings.push_back("DialogueDataLoader: Trigger '" + trigger +
+                                      "' has an invalid rule ('" + when + "' " + op + ").");
+                valid = false;
+                continue;
+            }
+
+            rules.push_back(rule);
+        }
+
+        // A half-loaded rule list would silently change which rule wins.
+        if (valid)
+            outSystem.SetTriggerRules(trigger, rules);
+    }
+
+    return true;
+}
@@ -35,11 +35,32 @@ public:
                                           DialogueSystem& outSystem,
                                           std::vector<std::string>& outWarnings);
 
+    // Load NPC voice archetypes (array of objects with "id", "role",
+    // slider values, "dialectTag", "personalMotifs" and an optional
+    // "cooldownSeconds" object keyed by function name, spelled as in
+    // DialogueFunction or all lowercase; other keys produce a warning).
+    static bool LoadArchetypesFromFile(const std::string& path,
+                                       DialogueSystem& outSystem,
+                                       std::vector<std::string>& outWarnings);
+
+    // Load trigger rules: an array of { "trigger", "rules" } objects where
+    // each rule is { "when", "op", "value", "function" }. "when" names a
+    // voice slider or context field; a rule without it always passes.
+    // Rules are tried in order and replace any existing rules for the tag.
+    // "trigger": "" sets the fallback for unknown tags; entries without a
+    // "trigger" key are skipped with a warning, as are triggers with any
+    // invalid rule (including a rule that is not an object).
+    static bool LoadTriggerRulesFromFile(const std::string& path,
+                                         DialogueSystem& outSystem,
+                                         std::vector<std::string>& outWarnings);
+
 private:
     static DialogueFunction ParseFunction(const std::string& s);
     static ReliabilityTag   ParseReliability(const std::string& s);
     static RegionTone       ParseRegionTone(const std::string& s);
     static SpeakerSocialRole ParseRole(const std::string& s);
+    static bool ParseTriggerInput(const std::string& s, TriggerRule::Input& out);
+    static bool ParseTriggerCompare(const std::string& s, TriggerRule::Compare& out);
 
     // Hard IP guardrail: reject any external IP references in surface text.
     static bool ContainsForbiddenIPTokens(const std::string& text);
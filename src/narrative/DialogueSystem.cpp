@@ -1,550 +1,5192 @@
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <random>
 #include <chrono>
+#include <cmath>
 #include <algorithm>
 #include <functional>
+#include <cstring>
+#include <limits>
 #include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // ------------------------------------------------------
 // Utility: RNG wrapper
 // ------------------------------------------------------
+// Counter-based generator: draw i of a stream is Mix64(key + i * gamma),
+// so a stream is fully described by (key, counter) and separate streams
+// share no state. Draws avoid <random> distributions so results are
+// identical across standard libraries.
 class RNG
 {
 public:
-    RNG()
+    explicit RNG(uint64_t streamKey = 0)
+        : key(streamKey)
     {
-        std::random_device rd;
-        engine.seed(rd());
+    }
+
+    // SplitMix64 finalizer.
+    static uint64_t Mix64(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Key of the stream used for one trigger of one NPC.
+    static uint64_t StreamKey(uint64_t sessionSeed, uint64_t npcKey, uint64_t triggerSequence)
+    {
+        return Mix64(Mix64(sessionSeed ^ Mix64(npcKey)) + triggerSequence);
+    }
+
+    uint64_t NextU64()
+    {
+        return Mix64(key + (++counter) * 0x9E3779B97F4A7C15ull);
     }
 
     int RandomInt(int minInclusive, int maxInclusive)
     {
-        std::uniform_int_distribution<int> dist(minInclusive, maxInclusive);
-        return dist(engine);
+        const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(maxInclusive) - minInclusive) + 1;
+        return static_cast<int>(minInclusive + static_cast<int64_t>(((NextU64() >> 32) * range) >> 32));
     }
 
     float RandomFloat(float minInclusive, float maxInclusive)
     {
-        std::uniform_real_distribution<float> dist(minInclusive, maxInclusive);
-        return dist(engine);
+        return minInclusive + (maxInclusive - minInclusive) * static_cast<float>(RandomUnit());
+    }
+
+    // Uniform in (0, 1]; safe to take the log of.
+    double RandomUnitOpenLow()
+    {
+        return static_cast<double>((NextU64() >> 11) + 1) * 0x1.0p-53;
+    }
+
+    // Uniform in [0, 1).
+    double RandomUnit()
+    {
+        return static_cast<double>(NextU64() >> 11) * 0x1.0p-53;
     }
 
     bool Chance(float probability01)
     {
         if (probability01 <= 0.0f) return false;
         if (probability01 >= 1.0f) return true;
-        std::bernoulli_distribution dist(probability01);
-        return dist(engine);
+        return RandomUnit() < probability01;
     }
 
 private:
-    std::mt19937 engine;
+    uint64_t key = 0;
+    uint64_t counter = 0;
 };
 
+// FNV-1a; stable across runs and platforms, unlike std::hash.
+constexpr uint64_t StableHash64(std::string_view s)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (char c : s)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
 // ------------------------------------------------------
-// Dialogue enums and small structs
+// Utility: string ID interning
 // ------------------------------------------------------
-enum class DialogueFunction
+// Maps KG / game string IDs to dense indices so hot paths can use
+// flat arrays instead of string hashing.
+class IdInterner
 {
-    NeutralAmbient,
-    Dread,
-    Misdirection,
-    RitualHint,
-    Rumor,
-    Bureaucratic,
-    ThreatBark,
-    Pain,
-    Surprise
-};
+public:
+    static constexpr uint32_t kInvalid = 0xFFFFFFFFu;
 
-enum class ReliabilityTag
-{
-    Unknown,
-    Truthful,
-    Partial,
-    KnownFalse
-};
+    uint32_t Intern(const std::string& s)
+    {
+        auto it = ids.find(s);
+        if (it != ids.end())
+            return it->second;
 
-enum class RegionTone
-{
-    ForestVillage,
-    SovietApartment,
-    IndustrialBlock,
-    BorderOutpost
+        const uint32_t id = static_cast<uint32_t>(names.size());
+        ids.emplace(s, id);
+        names.push_back(s);
+        return id;
+    }
+
+    uint32_t Find(const std::string& s) const
+    {
+        auto it = ids.find(s);
+        return it == ids.end() ? kInvalid : it->second;
+    }
+
+    const std::string& Name(uint32_t id) const { return names[id]; }
+    std::size_t Size() const { return names.size(); }
+
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> names;
 };
 
-enum class SpeakerSocialRole
+// ------------------------------------------------------
+// Utility: Vose alias table
+// ------------------------------------------------------
+// O(1) weighted sampling over a fixed set of weights; O(n) to build.
+class AliasTable
 {
-    Villager,
-    Bureaucrat,
-    Priest,
-    Smuggler,
-    Soldier,
-    Doctor,
-    Hermit
+public:
+    void Build(const std::vector<float>& weights)
+    {
+        const std::size_t n = weights.size();
+        prob.assign(n, 1.0f);
+        alias.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+            alias[i] = static_cast<uint32_t>(i);
+
+        double total = 0.0;
+        for (float w : weights)
+            total += w > 0.0f ? w : 0.0f;
+        if (n == 0)
+            return;
+        if (total <= 0.0)
+        {
+            // No positive weight: always the first entry, like the linear roll.
+            std::fill(prob.begin(), prob.end(), 0.0f);
+            std::fill(alias.begin(), alias.end(), 0u);
+            return;
+        }
+
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            scaled[i] = (weights[i] > 0.0f ? weights[i] : 0.0f) * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            const uint32_t s = small.back(); small.pop_back();
+            const uint32_t l = large.back();
+            prob[s] = static_cast<float>(scaled[s]);
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Leftovers are 1 up to rounding error.
+        for (uint32_t i : small) prob[i] = 1.0f;
+        for (uint32_t i : large) prob[i] = 1.0f;
+    }
+
+    std::size_t Size() const { return prob.size(); }
+
+    // One uniform in [0, 1) picks both the column and the coin.
+    uint32_t Sample(double u01) const
+    {
+        const double x = u01 * static_cast<double>(prob.size());
+        std::size_t column = static_cast<std::size_t>(x);
+        if (column >= prob.size())
+            column = prob.size() - 1;
+        const double coin = x - static_cast<double>(column);
+        return coin < prob[column] ? static_cast<uint32_t>(column) : alias[column];
+    }
+
+private:
+    std::vector<float>    prob;
+    std::vector<uint32_t> alias;
 };
 
-struct DialogueContext
+// ------------------------------------------------------
+// Utility: Fenwick (binary indexed) tree of weights
+// ------------------------------------------------------
+// O(log n) point updates and O(log n) weighted sampling by prefix sum.
+class FenwickTree
 {
-    RegionTone          regionTone = RegionTone::ForestVillage;
-    float               threatLevel01 = 0.0f;       // 0 = calm, 1 = lethal
-    bool                isIndoors = false;
-    bool                isNight = false;
-    bool                playerRecentlyBrokeTaboo = false;
-    bool                playerLowHealth = false;
-    bool                playerIsBleeding = false;
-    bool                inSafeRoomFlagged = false;
-    std::string         locationId;                 // e.g., "PLC_VILLAGE_ASHDITCH"
-    std::unordered_set<std::string> activeTabooIds; // e.g., "TABS_WHISTLE_AT_NIGHT"
-    std::unordered_set<std::string> recentEventIds; // e.g., "EV_WELL_COLLAPSE"
-    std::unordered_set<std::string> knownRumorIds;  // events NPC knows about
+public:
+    void Build(const std::vector<float>& weights)
+    {
+        values.assign(weights.size(), 0.0f);
+        tree.assign(weights.size() + 1, 0.0);
+        for (std::size_t i = 0; i < weights.size(); ++i)
+        {
+            values[i] = weights[i] > 0.0f ? weights[i] : 0.0f;
+            tree[i + 1] += values[i];
+            const std::size_t parent = (i + 1) + ((i + 1) & (~(i + 1) + 1));
+            if (parent < tree.size())
+                tree[parent] += tree[i + 1];
+        }
+    }
+
+    void Set(std::size_t i, float weight)
+    {
+        const float clamped = weight > 0.0f ? weight : 0.0f;
+        const double delta = static_cast<double>(clamped) - values[i];
+        values[i] = clamped;
+        for (std::size_t k = i + 1; k < tree.size(); k += k & (~k + 1))
+            tree[k] += delta;
+    }
+
+    double Total() const
+    {
+        double sum = 0.0;
+        for (std::size_t k = tree.size() - 1; k > 0; k -= k & (~k + 1))
+            sum += tree[k];
+        return sum;
+    }
+
+    std::size_t Size() const { return values.size(); }
+
+    // Slot whose cumulative range contains u01 * Total(); slot 0 when the
+    // total weight is zero.
+    std::size_t Sample(double u01) const
+    {
+        const double total = Total();
+        if (values.empty() || total <= 0.0)
+            return 0;
+
+        double target = u01 * total;
+        std::size_t pos = 0;
+        std::size_t step = 1;
+        while ((step << 1) < tree.size())
+            step <<= 1;
+
+        for (; step > 0; step >>= 1)
+        {
+            const std::size_t next = pos + step;
+            if (next < tree.size() && tree[next] <= target)
+            {
+                pos = next;
+                target -= tree[next];
+            }
+        }
+        // Step off zero-weight slots that rounding may land on.
+        if (pos >= values.size())
+            pos = values.size() - 1;
+        while (pos + 1 < values.size() && values[pos] <= 0.0f)
+            ++pos;
+        while (pos > 0 && values[pos] <= 0.0f)
+            --pos;
+        return pos;
+    }
+
+private:
+    std::vector<double> tree;   // 1-based partial sums
+    std::vector<float>  values;
 };
 
 // ------------------------------------------------------
-// Voice profile per NPC
+// Utility: recency window
 // ------------------------------------------------------
-struct NPCVoiceProfile
+// Last N picks (N <= Capacity) in a fixed ring buffer, with an
+// open-addressing count table for O(1) "was this picked recently?"
+// checks. Entries older than maxAgeSeconds (if > 0) count as not recent.
+template <std::size_t Capacity>
+class RecencyWindow
 {
-    std::string         npcId;                // unique ID
-    std::string         displayName;          // optional, for debugging
-    SpeakerSocialRole   role = SpeakerSocialRole::Villager;
+public:
+    void Configure(std::size_t maxPicks, double maxAgeSeconds)
+    {
+        Clear();
+        limit = maxPicks < Capacity ? maxPicks : Capacity;
+        maxAge = maxAgeSeconds;
+    }
 
-    // Style sliders (0..1)
-    float                verbosity01 = 0.4f;       // higher = longer sentences
-    float                superstition01 = 0.8f;    // higher = more taboos, spirits
-    float                bureaucratic01 = 0.0f;    // higher = drier, official tone
-    float                religiosity01 = 0.3f;
-    float                cruelty01 = 0.2f;         // matter‑of‑fact cruelty
-    float                unreliability01 = 0.4f;   // chance to lie or distort
-    float                fatalism01 = 0.7f;        // resigned, hopeless vibe
+    void Clear()
+    {
+        head = 0;
+        size = 0;
+        for (auto& slot : table)
+            slot = Slot();
+    }
 
-    // Vocabulary knobs
-    std::string          dialectTag;              // e.g., "rural_east", "block_1988"
-    std::vector<std::string> personalMotifs;      // e.g., "debts", "missing_children"
+    void Push(uint32_t key, double now)
+    {
+        if (limit == 0)
+            return;
+
+        if (size == limit)
+        {
+            Release(ring[head]);
+            head = (head + 1) % limit;
+            --size;
+        }
+        ring[(head + size) % limit] = key;
+        ++size;
+
+        Slot& slot = table[Probe(key)];
+        slot.key = key;
+        slot.count++;
+        slot.lastTime = now;
+    }
+
+    bool Contains(uint32_t key, double now) const
+    {
+        if (size == 0)
+            return false;
+        const Slot& slot = table[Probe(key)];
+        if (slot.key != key)
+            return false;
+        return maxAge <= 0.0 || now - slot.lastTime < maxAge;
+    }
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFFu;
 
-    // Internal cooldowns (per function), in seconds
-    std::unordered_map<DialogueFunction, float> cooldownSeconds =
+    static constexpr std::size_t TableSize()
     {
-        { DialogueFunction::NeutralAmbient, 20.0f },
-        { DialogueFunction::Dread,          15.0f },
-        { DialogueFunction::Misdirection,   25.0f },
-        { DialogueFunction::RitualHint,     45.0f },
-        { DialogueFunction::Rumor,          40.0f },
-        { DialogueFunction::Bureaucratic,   35.0f },
-        { DialogueFunction::ThreatBark,      5.0f },
-        { DialogueFunction::Pain,            3.0f },
-        { DialogueFunction::Surprise,        8.0f }
+        std::size_t n = 1;
+        while (n < Capacity * 2)
+            n <<= 1;
+        return n;
+    }
+
+    struct Slot
+    {
+        uint32_t key = kEmpty;
+        uint32_t count = 0;
+        double   lastTime = 0.0;
     };
+
+    // Slot holding key, or the empty slot where it would go.
+    std::size_t Probe(uint32_t key) const
+    {
+        std::size_t i = (key * 2654435761u) & (TableSize() - 1);
+        while (table[i].key != kEmpty && table[i].key != key)
+            i = (i + 1) & (TableSize() - 1);
+        return i;
+    }
+
+    void Release(uint32_t key)
+    {
+        std::size_t i = Probe(key);
+        if (--table[i].count > 0)
+            return;
+
+        // Backward-shift deletion keeps probe chains intact.
+        table[i] = Slot();
+        std::size_t j = i;
+        for (;;)
+        {
+            j = (j + 1) & (TableSize() - 1);
+            if (table[j].key == kEmpty)
+                return;
+            const std::size_t home = (table[j].key * 2654435761u) & (TableSize() - 1);
+            if (((j - home) & (TableSize() - 1)) >= ((j - i) & (TableSize() - 1)))
+            {
+                table[i] = table[j];
+                table[j] = Slot();
+                i = j;
+            }
+        }
+    }
+
+    std::array<uint32_t, Capacity>  ring{};
+    std::array<Slot, TableSize()>   table{};
+    std::size_t head = 0;
+    std::size_t size = 0;
+    std::size_t limit = 0;
+    double      maxAge = 0.0;
 };
 
 // ------------------------------------------------------
-// Dialogue template definition
+// Utility: hierarchical timing wheel
 // ------------------------------------------------------
-//
-// Text uses simple tokens that get replaced at runtime:
-//   {PLAYER_CALLSIGN}, {LOCAL_SPIRIT}, {TABOO}, {PLACE}, {BODYSYMPTOM}, etc.
-// The "weight" field is used for RNG selection.
-//
-struct DialogueTemplate
+// Two 256-slot levels (near: one tick per slot, far: 256 ticks per slot)
+// plus an overflow list. Schedule is O(1); Advance only touches the slots
+// the clock passes. A timer fires on the first tick at or after its due
+// time, i.e. at most one tick late.
+class TimingWheel
 {
-    std::string                 id;
-    DialogueFunction            function = DialogueFunction::NeutralAmbient;
-    ReliabilityTag              reliability = ReliabilityTag::Unknown;
-    RegionTone                  regionTone = RegionTone::ForestVillage;
+public:
+    static constexpr std::size_t kSlots = 256;
 
-    // Optional tags (used as soft filters)
-    std::vector<std::string>   requiredTabooIds;
-    std::vector<std::string>   requiredEventIds;
-    std::vector<std::string>   disallowedLocationIds;
-    std::vector<SpeakerSocialRole> allowedRoles;
+    explicit TimingWheel(double tickSecondsIn = 1.0 / 16.0)
+        : tickSeconds(tickSecondsIn)
+    {
+    }
 
-    // Short template text (one line). Slavic‑horror tone is controlled via content.
-    std::string                 text;
-    float                       weight = 1.0f;
+    void Schedule(uint64_t payload, double dueSeconds)
+    {
+        const int64_t dueTick = static_cast<int64_t>(std::ceil(dueSeconds / tickSeconds));
+        Insert(Timer{ payload, std::max(dueTick, currentTick + 1), dueSeconds });
+    }
 
-    // Conditions as lambdas (can be set at data load time)
-    std::function<bool(const DialogueContext&, const NPCVoiceProfile&)> condition;
+    // Calls fire(payload, dueSeconds) for every timer due by nowSeconds.
+    // Going back in time does nothing.
+    template <typename Fire>
+    void Advance(double nowSeconds, Fire&& fire)
+    {
+        const int64_t nowTick = static_cast<int64_t>(std::floor(nowSeconds / tickSeconds));
+        if (nowTick <= currentTick)
+            return;
+
+        // Long jumps: re-sort everything instead of walking every tick.
+        if (nowTick - currentTick >= static_cast<int64_t>(kSlots * kSlots))
+        {
+            std::vector<Timer> all;
+            all.swap(overflow);
+            for (std::size_t i = 0; i < kSlots; ++i)
+            {
+                all.insert(all.end(), nearSlots[i].begin(), nearSlots[i].end());
+                all.insert(all.end(), farSlots[i].begin(), farSlots[i].end());
+                nearSlots[i].clear();
+                farSlots[i].clear();
+            }
+            currentTick = nowTick;
+            for (const Timer& t : all)
+            {
+                if (t.dueTick <= nowTick)
+                    fire(t.payload, t.dueSeconds);
+                else
+                    Insert(t);
+            }
+            return;
+        }
+
+        while (currentTick < nowTick)
+        {
+            ++currentTick;
+            if ((currentTick & (kSlots - 1)) == 0)
+                Cascade();
+
+            std::vector<Timer>& slot = nearSlots[currentTick & (kSlots - 1)];
+            for (std::size_t i = 0; i < slot.size(); ++i)
+                fire(slot[i].payload, slot[i].dueSeconds);
+            slot.clear();
+        }
+    }
+
+private:
+    struct Timer
+    {
+        uint64_t payload;
+        int64_t  dueTick;
+        double   dueSeconds;
+    };
+
+    void Insert(const Timer& t)
+    {
+        const int64_t span = static_cast<int64_t>(kSlots);
+        if (t.dueTick < currentTick + span)
+            nearSlots[t.dueTick & (span - 1)].push_back(t);
+        else if ((t.dueTick >> 8) < (currentTick >> 8) + span)
+            farSlots[(t.dueTick >> 8) & (span - 1)].push_back(t);
+        else
+            overflow.push_back(t);
+    }
+
+    // Called when currentTick enters a new 256-tick block.
+    void Cascade()
+    {
+        // Swap through a scratch list so slot storage is reused.
+        cascadeScratch.clear();
+        cascadeScratch.swap(farSlots[(currentTick >> 8) & (kSlots - 1)]);
+        if (((currentTick >> 8) & (kSlots - 1)) == 0)
+        {
+            cascadeScratch.insert(cascadeScratch.end(), overflow.begin(), overflow.end());
+            overflow.clear();
+        }
+        for (const Timer& t : cascadeScratch)
+            Insert(t);
+    }
+
+    double  tickSeconds;
+    int64_t currentTick = 0;
+    std::array<std::vector<Timer>, kSlots> nearSlots;
+    std::array<std::vector<Timer>, kSlots> farSlots;
+    std::vector<Timer> overflow;
+    std::vector<Timer> cascadeScratch;
 };
 
 // ------------------------------------------------------
-// DialogueSystem core
+// Utility: time-ordered event ring
 // ------------------------------------------------------
-class DialogueSystem
+// Newest `capacity` events of one region, oldest first; pushing into a
+// full ring overwrites the oldest. Timestamps never decrease, so the
+// first event at or after a time is found by binary search.
+class EventRing
 {
 public:
-    DialogueSystem()
+    struct Entry
     {
-        InitializeDefaultTemplates();
-        lastFireTimestamps.reserve(256);
-    }
+        double   timestampSeconds = 0.0;
+        double   decayScore = 0.0;    // log2(severity) + timestamp / half-life
+        float    severity01 = 0.0f;   // at notification time
+        uint32_t eventId = 0;         // interned
+    };
 
-    // Call this each frame or tick with global time (seconds)
-    void SetCurrentTimeSeconds(double t)
+    void SetCapacity(std::size_t capacity)
     {
-        currentTimeSeconds = t;
+        std::vector<Entry> kept;
+        const std::size_t keep = std::min(capacity, count);
+        kept.reserve(capacity);
+        for (std::size_t i = count - keep; i < count; ++i)
+            kept.push_back(At(i));
+        kept.resize(capacity);
+        entries.swap(kept);
+        head = 0;
+        count = keep;
     }
 
-    void RegisterNPCProfile(const NPCVoiceProfile& profile)
+    void Push(Entry e)
     {
-        npcProfiles[profile.npcId] = profile;
+        if (entries.empty())
+            return;
+        if (count > 0)
+            e.timestampSeconds = std::max(e.timestampSeconds, At(count - 1).timestampSeconds);
+
+        if (count < entries.size())
+        {
+            entries[(head + count) % entries.size()] = e;
+            ++count;
+        }
+        else
+        {
+            entries[head] = e;
+            head = (head + 1) % entries.size();
+        }
     }
 
-    const NPCVoiceProfile* GetNPCProfile(const std::string& npcId) const
+    // Index of the first entry with timestampSeconds >= t (Size() if none).
+    std::size_t LowerBound(double t) const
     {
-        auto it = npcProfiles.find(npcId);
-        if (it == npcProfiles.end()) return nullptr;
-        return &it->second;
+        std::size_t lo = 0;
+        std::size_t hi = count;
+        while (lo < hi)
+        {
+            const std::size_t mid = (lo + hi) / 2;
+            if (At(mid).timestampSeconds < t)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
     }
 
-    // Main API used by AI / scripts.
-    // "triggerTag" can be something like "on_enter_safehouse",
-    // "on_player_breaks_taboo", "on_night_heartbeat", "on_enemy_spotted", etc.
-    std::string GenerateLine(const std::string& npcId,
-                             const std::string& triggerTag,
-                             const DialogueContext& ctx)
-    {
-        const NPCVoiceProfile* profile = GetNPCProfile(npcId);
-        if (!profile) return std::string();
+    const Entry& At(std::size_t i) const { return entries[(head + i) % entries.size()]; }
+    Entry& At(std::size_t i) { return entries[(head + i) % entries.size()]; }
+    std::size_t Size() const { return count; }
+
+private:
+    std::vector<Entry> entries;
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+// ------------------------------------------------------
+// Utility: persistent worker pool
+// ------------------------------------------------------
+// Threads are started on first use and parked between jobs, so a job
+// costs a wake-up per worker rather than a thread start. One job runs at
+// a time; Run blocks until every worker has finished it.
+class WorkerPool
+{
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
 
-        // Map triggerTag to a target function
-        DialogueFunction desiredFunction = MapTriggerToFunction(triggerTag, ctx, *profile);
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : threads)
+            t.join();
+    }
 
-        // Cooldown check
-        if (!CanFire(*profile, desiredFunction))
-            return std::string();
+    // Calls job(w) for every w in [0, workers); w = 0 runs on the calling
+    // thread.
+    template <typename Job>
+    void Run(std::size_t workers, Job& job)
+    {
+        while (threads.size() + 1 < workers)
+        {
+            const std::size_t index = threads.size() + 1;
+            threads.emplace_back([this, index] { Loop(index); });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &Invoke<Job>;
+            context = &job;
+            taskWorkers = workers;
+            pending = workers - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        job(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    template <typename Job>
+    static void Invoke(void* job, std::size_t w)
+    {
+        (*static_cast<Job*>(job))(w);
+    }
+
+    void Loop(std::size_t index)
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            if (index >= taskWorkers)
+                continue;   // not needed for this job
+
+            void (*run)(void*, std::size_t) = task;
+            void* job = context;
+            lock.unlock();
+            run(job, index);
+            lock.lock();
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads;     // worker w is threads[w - 1]
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*task)(void*, std::size_t) = nullptr;
+    void* context = nullptr;
+    std::size_t taskWorkers = 0;
+    std::size_t pending = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+// ------------------------------------------------------
+// Utility: rumor diffusion
+// ------------------------------------------------------
+// Who knows which rumor, as two bit planes (known, distorted) tiled in
+// blocks of 512 rumors: inside a block each NPC slot owns one 64-byte
+// line, and a step hands whole blocks to worker threads that share
+// nothing. Passing a block along an edge is one line read. The graph
+// is CSR by listener. A step is one hop: each edge talks with its own
+// chance, and a talking speaker passes on every rumor it knew at the
+// start of the step, distorted with the speaker's distortion chance.
+// Draws are keyed by (step key, edge), so results do not depend on the
+// number of threads.
+class RumorDiffusion
+{
+public:
+    struct Edge
+    {
+        uint32_t speaker = 0;
+        uint32_t listener = 0;
+        float    talkChance01 = 0.0f;
+    };
+
+    // Replaces the graph; edges must name slots below `npcSlots`.
+    // Detached slots are reattached.
+    void SetGraph(std::size_t npcSlots, const std::vector<Edge>& edges)
+    {
+        Reserve(npcSlots, rumorCount);
+        offsets.assign(npcCapacity + 1, 0);
+        for (const Edge& e : edges)
+            ++offsets[e.listener + 1];
+        for (std::size_t i = 0; i < npcCapacity; ++i)
+            offsets[i + 1] += offsets[i];
+
+        speakers.resize(edges.size());
+        talkThresholds.resize(edges.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (const Edge& e : edges)
+        {
+            const uint32_t slot = fill[e.listener]++;
+            speakers[slot] = e.speaker;
+            talkThresholds[slot] = Threshold(e.talkChance01);
+        }
+        std::fill(detached.begin(), detached.end(), 0);
+    }
+
+    // Grows storage to hold `npcSlots` slots and `rumors` rumors.
+    void Reserve(std::size_t npcSlots, std::size_t rumors)
+    {
+        std::size_t capacity = npcCapacity;
+        while (capacity < npcSlots)
+            capacity = std::max<std::size_t>(64, capacity * 2);
+        const std::size_t newBlocks = (std::max(rumors, rumorCount) + kBlockBits - 1) / kBlockBits;
+
+        if (capacity != npcCapacity)
+        {
+            Relayout(known, capacity, newBlocks);
+            Relayout(distorted, capacity, newBlocks);
+            std::vector<uint8_t> grown(newBlocks * capacity, 0);
+            for (std::size_t b = 0; b < blocks; ++b)
+                std::copy_n(occupied.begin() + b * npcCapacity, npcCapacity, grown.begin() + b * capacity);
+            occupied.swap(grown);
+            offsets.resize(capacity + 1, offsets.empty() ? 0 : offsets.back());
+            npcCapacity = capacity;
+        }
+        else
+        {
+            known.resize(newBlocks * BlockSize(), 0);
+            distorted.resize(newBlocks * BlockSize(), 0);
+            occupied.resize(newBlocks * npcCapacity, 0);
+        }
+        blocks = newBlocks;
+        rumorCount = std::max(rumors, rumorCount);
+        counts.resize(npcCapacity, 0);
+        detached.resize(npcCapacity, 0);
+    }
+
+    // Marks `rumor` known by `npc` (first-hand unless `isDistorted`).
+    void Learn(uint32_t npc, uint32_t rumor, bool isDistorted)
+    {
+        const std::size_t i = Cell(npc, rumor);
+        const uint64_t bit = 1ull << (rumor % 64);
+        counts[npc] += (known[i] & bit) ? 0 : 1;
+        known[i] |= bit;
+        occupied[(rumor / kBlockBits) * npcCapacity + npc] = 1;
+        distorted[i] = isDistorted ? (distorted[i] | bit) : (distorted[i] & ~bit);
+    }
+
+    // Forgets everything the slot knew; with `detach`, its edges are
+    // ignored until the next SetGraph.
+    void ClearNPC(uint32_t npc, bool detach)
+    {
+        if (npc >= npcCapacity)
+            return;
+        for (std::size_t b = 0; b < blocks; ++b)
+        {
+            std::fill_n(&known[Line(b, npc)], kBlockWords, 0);
+            std::fill_n(&distorted[Line(b, npc)], kBlockWords, 0);
+            occupied[b * npcCapacity + npc] = 0;
+        }
+        counts[npc] = 0;
+        detached[npc] = detach ? 1 : 0;
+    }
+
+    // Forgets every rumor; the graph and detached slots stay.
+    void ClearKnowledge()
+    {
+        std::fill(known.begin(), known.end(), 0);
+        std::fill(distorted.begin(), distorted.end(), 0);
+        std::fill(occupied.begin(), occupied.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+    }
+
+    bool Knows(uint32_t npc, uint32_t rumor, bool* outDistorted) const
+    {
+        if (npc >= npcCapacity || rumor >= rumorCount)
+            return false;
+        const std::size_t i = Cell(npc, rumor);
+        const uint64_t bit = 1ull << (rumor % 64);
+        if (outDistorted)
+            *outDistorted = (distorted[i] & bit) != 0;
+        return (known[i] & bit) != 0;
+    }
+
+    uint32_t KnownCount(uint32_t npc) const
+    {
+        return npc < npcCapacity ? counts[npc] : 0;
+    }
+
+    template <typename Fn>
+    void ForEachKnown(uint32_t npc, Fn fn) const
+    {
+        if (npc >= npcCapacity)
+            return;
+        for (std::size_t w = 0; w < blocks * kBlockWords; ++w)
+        {
+            for (uint64_t bits = known[Line(w / kBlockWords, npc) + w % kBlockWords]; bits != 0; bits &= bits - 1)
+                fn(static_cast<uint32_t>(w * 64 + Popcount64((bits & (~bits + 1)) - 1)));
+        }
+    }
+
+    // One hop. `distortThresholds[speaker]` is the speaker's distortion
+    // chance scaled to 2^32.
+    void Step(uint64_t stepKey, const std::vector<uint32_t>& distortThresholds, std::size_t threads)
+    {
+        const std::size_t workers = std::max<std::size_t>(1, threads);
+        if (scratch.size() < workers)
+            scratch.resize(workers);
+
+        // Phase 1: edges that talk this step, in listener order.
+        ParallelFor(npcCapacity, workers, [&](std::size_t w, std::size_t begin, std::size_t end)
+        {
+            std::vector<ActiveEdge>& out = scratch[w].active;
+            out.clear();
+            for (std::size_t l = begin; l < end; ++l)
+            {
+                if (detached[l])
+                    continue;
+                for (uint32_t e = offsets[l]; e < offsets[l + 1]; ++e)
+                {
+                    const uint32_t s = speakers[e];
+                    const uint64_t draw = RNG::Mix64(stepKey + e * 0x9E3779B97F4A7C15ull);
+                    if (detached[s] || (draw >> 32) >= talkThresholds[e])
+                        continue;
+                    const bool distort = static_cast<uint32_t>(draw) < distortThresholds[s];
+                    out.push_back(ActiveEdge{ static_cast<uint32_t>(l), s, distort ? ~0ull : 0ull });
+                }
+            }
+        });
+        active.clear();
+        for (std::size_t w = 0; w < std::min(workers, npcCapacity); ++w)
+            active.insert(active.end(), scratch[w].active.begin(), scratch[w].active.end());
+        if (active.empty())
+            return;
+
+        // Gathers run in speaker order and applies in listener order, so
+        // both walk each block front to back.
+        speakerStarts.assign(npcCapacity + 1, 0);
+        for (const ActiveEdge& e : active)
+            ++speakerStarts[e.speaker + 1];
+        for (std::size_t i = 0; i < npcCapacity; ++i)
+            speakerStarts[i + 1] += speakerStarts[i];
+        gatherOrder.resize(active.size());
+        for (uint32_t i = 0; i < active.size(); ++i)
+            gatherOrder[speakerStarts[active[i].speaker]++] = i;
+
+        // Phase 2: per block, gather what speakers knew, then apply it.
+        ParallelFor(blocks, workers, [&](std::size_t w, std::size_t begin, std::size_t end)
+        {
+            Scratch& local = scratch[w];
+            local.heardKnown.resize(active.size() * kBlockWords);
+            local.heardDistorted.resize(active.size() * kBlockWords);
+            local.heardSlot.resize(active.size());
+            local.learned.assign(npcCapacity, 0);
+            for (std::size_t b = begin; b < end; ++b)
+            {
+                // Speakers that know nothing in this block are skipped
+                // without touching their lines (the common, sparse case).
+                uint8_t* used = &occupied[b * npcCapacity];
+                uint32_t heard = 0;
+                for (uint32_t i : gatherOrder)
+                {
+                    local.heardSlot[i] = kNotHeard;
+                    if (!used[active[i].speaker])
+                        continue;
+                    const uint64_t* k = &known[Line(b, active[i].speaker)];
+                    const uint64_t* d = &distorted[Line(b, active[i].speaker)];
+                    uint64_t* hk = &local.heardKnown[heard * kBlockWords];
+                    uint64_t* hd = &local.heardDistorted[heard * kBlockWords];
+                    for (std::size_t j = 0; j < kBlockWords; ++j)
+                    {
+                        hk[j] = k[j];
+                        hd[j] = d[j] | active[i].distortMask;
+                    }
+                    local.heardSlot[i] = heard++;
+                }
+                for (std::size_t i = 0; i < active.size(); ++i)
+                {
+                    const uint32_t slot = local.heardSlot[i];
+                    if (slot == kNotHeard)
+                        continue;
+                    const uint32_t l = active[i].listener;
+                    uint64_t* k = &known[Line(b, l)];
+                    uint64_t* d = &distorted[Line(b, l)];
+                    const uint64_t* hk = &local.heardKnown[slot * kBlockWords];
+                    const uint64_t* hd = &local.heardDistorted[slot * kBlockWords];
+                    used[l] = 1;
+                    uint32_t learned = 0;
+                    for (std::size_t j = 0; j < kBlockWords; ++j)
+                    {
+                        const uint64_t fresh = hk[j] & ~k[j];
+                        k[j] |= fresh;
+                        d[j] |= fresh & hd[j];
+                        learned += Popcount64(fresh);
+                    }
+                    local.learned[l] += learned;
+                }
+            }
+        });
+
+        const std::size_t ran = std::min(workers, blocks);
+        ParallelFor(npcCapacity, workers, [&](std::size_t, std::size_t begin, std::size_t end)
+        {
+            for (std::size_t w = 0; w < ran; ++w)
+            {
+                for (std::size_t l = begin; l < end; ++l)
+                    counts[l] += scratch[w].learned[l];
+            }
+        });
+    }
+
+    static uint64_t Threshold(float chance01)
+    {
+        const double p = std::min(std::max(static_cast<double>(chance01), 0.0), 1.0);
+        return static_cast<uint64_t>(p * 4294967296.0);
+    }
+
+private:
+    static constexpr std::size_t kBlockWords = 8;
+    static constexpr std::size_t kBlockBits = kBlockWords * 64;
+
+    struct ActiveEdge
+    {
+        uint32_t listener;
+        uint32_t speaker;
+        uint64_t distortMask;
+    };
+
+    static constexpr uint32_t kNotHeard = 0xFFFFFFFFu;
+
+    struct Scratch
+    {
+        std::vector<ActiveEdge> active;
+        std::vector<uint32_t>   heardSlot;        // per active edge
+        std::vector<uint64_t>   heardKnown;
+        std::vector<uint64_t>   heardDistorted;
+        std::vector<uint32_t>   learned;
+    };
+
+    static uint32_t Popcount64(uint64_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<uint32_t>(__builtin_popcountll(x));
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<uint32_t>((x * 0x0101010101010101ull) >> 56);
+#endif
+    }
+
+    // Splits [0, count) into contiguous chunks, one per worker; chunk 0
+    // runs on the calling thread, the rest on the diffusion's own pool.
+    template <typename Fn>
+    void ParallelFor(std::size_t count, std::size_t workers, Fn fn)
+    {
+        workers = std::max<std::size_t>(1, std::min(workers, count));
+        auto chunk = [&](std::size_t w) { fn(w, count * w / workers, count * (w + 1) / workers); };
+        if (workers == 1)
+        {
+            chunk(0);
+            return;
+        }
+        if (!pool)
+            pool = std::make_unique<WorkerPool>();
+        pool->Run(workers, chunk);
+    }
+
+    std::size_t BlockSize() const { return npcCapacity * kBlockWords; }
+
+    // First word of `npc`'s line in block `block`.
+    std::size_t Line(std::size_t block, std::size_t npc) const
+    {
+        return block * BlockSize() + npc * kBlockWords;
+    }
+
+    std::size_t Cell(uint32_t npc, uint32_t rumor) const
+    {
+        return Line(rumor / kBlockBits, npc) + (rumor % kBlockBits) / 64;
+    }
+
+    void Relayout(std::vector<uint64_t>& plane, std::size_t capacity, std::size_t newBlocks) const
+    {
+        std::vector<uint64_t> grown(newBlocks * capacity * kBlockWords, 0);
+        for (std::size_t b = 0; b < blocks; ++b)
+            std::copy_n(plane.begin() + b * BlockSize(), BlockSize(), grown.begin() + b * capacity * kBlockWords);
+        plane.swap(grown);
+    }
+
+    std::size_t npcCapacity = 0;
+    std::size_t rumorCount = 0;
+    std::size_t blocks = 0;
+    std::vector<uint64_t> known;        // [block][npc][kBlockWords]
+    std::vector<uint64_t> distorted;    // same layout, subset of known
+    std::vector<uint8_t>  occupied;     // [block][npc]: line may be non-zero
+    std::vector<uint32_t> counts;       // known rumors per npc
+    std::vector<uint8_t>  detached;
+
+    std::vector<uint32_t> offsets;      // CSR by listener
+    std::vector<uint32_t> speakers;
+    std::vector<uint64_t> talkThresholds;
+
+    std::vector<ActiveEdge> active;
+    std::vector<uint32_t>   gatherOrder;      // active edges by speaker
+    std::vector<uint32_t>   speakerStarts;
+    std::vector<Scratch>    scratch;
+    std::unique_ptr<WorkerPool> pool;         // started on the first multi-threaded step
+};
+
+// ------------------------------------------------------
+// Utility: fixed-capacity line buffer
+// ------------------------------------------------------
+// Text builder over caller-owned storage; never allocates. Writes past
+// the capacity are cut at a UTF-8 boundary and flagged.
+class LineBuffer
+{
+public:
+    LineBuffer(char* storage, std::size_t capacityBytes)
+        : data(storage), capacity(capacityBytes)
+    {
+    }
+
+    void Append(std::string_view s)
+    {
+        const std::size_t n = FitUtf8(s, capacity - size);
+        std::memcpy(data + size, s.data(), n);
+        size += n;
+    }
+
+    void Truncate(std::size_t length)
+    {
+        if (length < size)
+            size = length;
+    }
+
+    // Largest position <= pos that does not split a UTF-8 sequence.
+    std::size_t Utf8Floor(std::size_t pos) const
+    {
+        if (pos >= size)
+            return size;
+        while (pos > 0 && (static_cast<unsigned char>(data[pos]) & 0xC0) == 0x80)
+            --pos;
+        return pos;
+    }
+
+    std::size_t RFind(char c, std::size_t pos) const
+    {
+        return View().rfind(c, pos);
+    }
+
+    bool Empty() const { return size == 0; }
+    std::size_t Size() const { return size; }
+    char& Back() { return data[size - 1]; }
+    bool Overflowed() const { return overflowed; }
+    std::string_view View() const { return std::string_view(data, size); }
+
+private:
+    std::size_t FitUtf8(std::string_view s, std::size_t room)
+    {
+        if (s.size() <= room)
+            return s.size();
+
+        overflowed = true;
+        std::size_t n = room;
+        while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80)
+            --n;
+        return n;
+    }
+
+    char*       data = nullptr;
+    std::size_t capacity = 0;
+    std::size_t size = 0;
+    bool        overflowed = false;
+};
+
+// ------------------------------------------------------
+// Dialogue enums and small structs
+// ------------------------------------------------------
+enum class DialogueFunction
+{
+    NeutralAmbient,
+    Dread,
+    Misdirection,
+    RitualHint,
+    Rumor,
+    Bureaucratic,
+    ThreatBark,
+    Pain,
+    Surprise
+};
+
+constexpr std::size_t kDialogueFunctionCount = 9;
+
+enum class ReliabilityTag
+{
+    Unknown,
+    Truthful,
+    Partial,
+    KnownFalse
+};
+
+enum class RegionTone
+{
+    ForestVillage,
+    SovietApartment,
+    IndustrialBlock,
+    BorderOutpost
+};
+
+constexpr std::size_t kRegionToneCount = 4;
+
+enum class SpeakerSocialRole
+{
+    Villager,
+    Bureaucrat,
+    Priest,
+    Smuggler,
+    Soldier,
+    Doctor,
+    Hermit
+};
+
+struct DialogueContext
+{
+    RegionTone          regionTone = RegionTone::ForestVillage;
+    float               threatLevel01 = 0.0f;       // 0 = calm, 1 = lethal
+    bool                isIndoors = false;
+    bool                isNight = false;
+    bool                playerRecentlyBrokeTaboo = false;
+    bool                playerLowHealth = false;
+    bool                playerIsBleeding = false;
+    bool                inSafeRoomFlagged = false;
+    std::string         locationId;                 // e.g., "PLC_VILLAGE_ASHDITCH"
+    std::string         regionId;                   // tracked region; overrides the taboo/event sets below
+    std::unordered_set<std::string> activeTabooIds; // e.g., "TABS_WHISTLE_AT_NIGHT"
+    std::unordered_set<std::string> recentEventIds; // e.g., "EV_WELL_COLLAPSE"
+    std::unordered_set<std::string> knownRumorIds;  // events NPC knows about
+};
+
+// Sorted, unique interned IDs. Short lists live inline; longer ones spill
+// to a shared array, so copying a list never copies the IDs. Set copies
+// a shared array before editing it.
+class PackedIdList
+{
+public:
+    static constexpr std::size_t kInline = 4;
+
+    // Sorts `ids` in place. Longer lists are copied to a shared array,
+    // so copies of this list share it.
+    void Assign(std::vector<uint32_t>& ids)
+    {
+        if (SortInline(ids))
+            return;
+        spill = std::make_shared<std::vector<uint32_t>>(ids);
+        spilled = spill->data();
+    }
+
+    // As Assign, but a longer list points into `ids`, which must not
+    // change while this list (or a copy of it) is in use. Lets a scratch
+    // vector that keeps its capacity back the list without allocating.
+    void AssignView(std::vector<uint32_t>& ids)
+    {
+        if (SortInline(ids))
+            return;
+        spill.reset();
+        spilled = ids.data();
+    }
+
+    // Adds (`present`) or removes one ID; returns false if the list
+    // already had that state.
+    bool Set(uint32_t id, bool present)
+    {
+        const uint32_t* first = begin();
+        const uint32_t* pos = std::lower_bound(first, end(), id);
+        if ((pos != end() && *pos == id) == present)
+            return false;
+
+        const std::size_t at = static_cast<std::size_t>(pos - first);
+        const uint32_t newCount = present ? count + 1 : count - 1;
+        if (newCount <= kInline)
+        {
+            std::array<uint32_t, kInline> ids{};
+            std::copy(first, pos, ids.begin());
+            if (present)
+                ids[at] = id;
+            std::copy(present ? pos : pos + 1, end(), ids.begin() + at + (present ? 1 : 0));
+            inlineIds = ids;
+            spill.reset();
+            spilled = nullptr;
+        }
+        else
+        {
+            if (!spill || spill.use_count() > 1)
+                spill = std::make_shared<std::vector<uint32_t>>(first, end());
+            if (present)
+                spill->insert(spill->begin() + at, id);
+            else
+                spill->erase(spill->begin() + at);
+            spilled = spill->data();
+        }
+        count = newCount;
+        return true;
+    }
+
+    bool Contains(uint32_t id) const { return std::binary_search(begin(), end(), id); }
+
+    const uint32_t* begin() const { return count <= kInline ? inlineIds.data() : spilled; }
+    const uint32_t* end() const { return begin() + count; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+private:
+    // Sorts and dedups `ids`; returns true if they fit inline.
+    bool SortInline(std::vector<uint32_t>& ids)
+    {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        count = static_cast<uint32_t>(ids.size());
+        if (count > kInline)
+            return false;
+        std::copy(ids.begin(), ids.end(), inlineIds.begin());
+        spill.reset();
+        spilled = nullptr;
+        return true;
+    }
+
+    uint32_t count = 0;
+    std::array<uint32_t, kInline> inlineIds{};
+    const uint32_t* spilled = nullptr;                  // longer lists
+    std::shared_ptr<std::vector<uint32_t>> spill;       // owns `spilled`, unless a view
+};
+
+// The form of DialogueContext every internal stage reads: one flag word,
+// threat quantized to 1/255, and IDs interned by the DialogueSystem that
+// packed it (DialogueSystem::PackContext). IDs are only meaningful to
+// that system. Packing never interns: names the system has not seen
+// (in templates, region state, SeedRumor or DeclareContextIds) cannot
+// match anything and are dropped.
+struct PackedDialogueContext
+{
+    enum Flag : uint8_t
+    {
+        Indoors                  = 1 << 0,
+        Night                    = 1 << 1,
+        PlayerRecentlyBrokeTaboo = 1 << 2,
+        PlayerLowHealth          = 1 << 3,
+        PlayerIsBleeding         = 1 << 4,
+        InSafeRoom               = 1 << 5
+    };
+
+    uint8_t      flags = 0;
+    uint8_t      threat = 0;                          // threatLevel01 * 255, rounded
+    RegionTone   regionTone = RegionTone::ForestVillage;
+    uint32_t     locationId = IdInterner::kInvalid;
+    uint32_t     regionId = IdInterner::kInvalid;
+    PackedIdList tabooIds;
+    PackedIdList eventIds;
+    PackedIdList rumorIds;
+    uint32_t     unnamedRumors = 0;                   // dropped knownRumorIds; still counted
+
+    static uint8_t QuantizeThreat(float threatLevel01)
+    {
+        if (!(threatLevel01 > 0.0f))
+            return 0;
+        return static_cast<uint8_t>(std::min(threatLevel01, 1.0f) * 255.0f + 0.5f);
+    }
+
+    bool Has(Flag flag) const { return (flags & flag) != 0; }
+
+    void Set(Flag flag, bool value)
+    {
+        flags = value ? (flags | flag) : (flags & ~flag);
+    }
+
+    float ThreatLevel01() const { return threat / 255.0f; }
+
+    // Compare on the quantized scale, so a threshold equal to the
+    // unpacked threat level still compares equal.
+    bool ThreatAbove(float threshold) const
+    {
+        return threshold < 0.0f || threat > QuantizeThreat(threshold);
+    }
+
+    bool ThreatAtLeast(float threshold) const
+    {
+        return threshold <= 1.0f && threat >= QuantizeThreat(threshold);
+    }
+};
+
+// Region-wide part of a context, set with DialogueSystem::SetRegionAmbient.
+struct RegionAmbient
+{
+    RegionTone  regionTone = RegionTone::ForestVillage;
+    float       threatLevel01 = 0.0f;
+    bool        isNight = false;
+    bool        isIndoors = false;
+    std::string locationId;
+};
+
+// Immutable, versioned context shared by every NPC in a region; see
+// DialogueSystem::GetRegionContext. Updates never touch a snapshot that
+// is still held: they copy it first.
+struct RegionContextSnapshot
+{
+    PackedDialogueContext packed;      // packed by the owning system
+    uint64_t              version = 0; // unique across regions
+};
+
+// The fields one NPC perceives differently from its region's snapshot.
+// Fields not in `mask` are taken from the snapshot.
+struct DialogueContextOverlay
+{
+    enum Field : uint8_t
+    {
+        Indoors                  = 1 << 0,
+        PlayerRecentlyBrokeTaboo = 1 << 1,
+        PlayerLowHealth          = 1 << 2,
+        PlayerIsBleeding         = 1 << 3,
+        InSafeRoom               = 1 << 4,
+        Threat                   = 1 << 5
+    };
+
+    uint8_t mask = 0;
+    uint8_t flags = 0;
+    float   threatLevel01 = 0.0f;
+
+    DialogueContextOverlay& Set(Field field, bool value)
+    {
+        mask |= field;
+        flags = value ? (flags | field) : (flags & ~field);
+        return *this;
+    }
+
+    DialogueContextOverlay& SetThreat(float value)
+    {
+        mask |= Threat;
+        threatLevel01 = value;
+        return *this;
+    }
+
+    void ApplyTo(PackedDialogueContext& ctx) const
+    {
+        using Packed = PackedDialogueContext;
+        auto apply = [&](Field field, Packed::Flag flag)
+        {
+            if (mask & field)
+                ctx.Set(flag, (flags & field) != 0);
+        };
+        apply(Indoors, Packed::Indoors);
+        apply(PlayerRecentlyBrokeTaboo, Packed::PlayerRecentlyBrokeTaboo);
+        apply(PlayerLowHealth, Packed::PlayerLowHealth);
+        apply(PlayerIsBleeding, Packed::PlayerIsBleeding);
+        apply(InSafeRoom, Packed::InSafeRoom);
+        if (mask & Threat)
+            ctx.threat = Packed::QuantizeThreat(threatLevel01);
+    }
+};
+
+// How GenerateLine picks among candidates.
+enum class SamplingMode
+{
+    Streaming,      // weighted reservoir sample fused with filtering, no candidate vector
+    Materialized    // collect candidates, then cumulative-weight roll
+};
+
+// Anti-repetition windows. A template picked within the NPC's or the
+// global window has its weight multiplied by recentWeightScale (0 =
+// excluded unless nothing else is eligible). The global window is off
+// by default, since it changes which lines other NPCs can pick; e.g. 16
+// picks / 60 s keeps a village from repeating one line.
+struct RecencyPolicy
+{
+    std::size_t npcWindowPicks = 3;       // per NPC, up to 8
+    double      npcWindowSeconds = 0.0;   // 0 = no age limit
+    std::size_t globalWindowPicks = 0;    // whole system, up to 64; 0 = off
+    double      globalWindowSeconds = 60.0;
+    float       recentWeightScale = 0.0f;
+};
+
+// Token-bucket limit for one function within a throttle group: up to
+// `burst` lines at once, refilling at ratePerSecond. burst <= 0 = no limit.
+struct BarkThrottle
+{
+    float ratePerSecond = 0.0f;
+    float burst = 0.0f;
+};
+
+// Background cleanup done a few items per SetCurrentTimeSeconds call.
+struct SweepPolicy
+{
+    std::size_t itemsPerTick = 32;               // NPC/voice slots visited
+    double      idleNPCSeconds = 120.0;          // drop cached weight trees after this
+};
+
+// Emergent event store (DialogueSystem::NotifyEvent). Severity decays
+// by half every severityHalfLifeSeconds (<= 0: no decay); it is computed
+// when queried, never stored. Events older than retentionSeconds, or
+// pushed out of their region's ring, are gone.
+struct EmergentEventPolicy
+{
+    std::size_t perRegionCapacity = 64;
+    double      severityHalfLifeSeconds = 300.0;
+    double      retentionSeconds = 600.0;
+    float       rumorSeverity01 = 0.25f;         // fresh events above this are rumors
+};
+
+// Rumor diffusion tuning. A speaker distorts what it passes on with
+// probability unreliability01 * distortionScale; workerThreads 0 means
+// one per hardware thread.
+struct RumorDiffusionPolicy
+{
+    float       distortionScale = 0.5f;
+    std::size_t workerThreads = 0;
+};
+
+// One result of DialogueSystem::QueryRegionEvents.
+struct EmergentEventView
+{
+    std::string_view eventId;
+    float            severity01 = 0.0f;          // decayed to the current time
+    double           timestampSeconds = 0.0;
+};
+
+// Dense ID from DialogueSystem::CreateThrottleGroup (squads, regions).
+using ThrottleGroupId = uint32_t;
+constexpr ThrottleGroupId kNoThrottleGroup = 0xFFFFFFFFu;
+
+// Ordered function tiers for GenerateLine fallback,
+// e.g. FallbackLadder().Then(Dread).Then(Rumor).Then(NeutralAmbient).
+struct FallbackLadder
+{
+    std::array<DialogueFunction, kDialogueFunctionCount> tiers{};
+    std::size_t count = 0;
+
+    FallbackLadder& Then(DialogueFunction fn)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (tiers[i] == fn)
+                return *this;
+        }
+        if (count < tiers.size())
+            tiers[count++] = fn;
+        return *this;
+    }
+};
+
+// ------------------------------------------------------
+// Voice profile per NPC
+// ------------------------------------------------------
+struct NPCVoiceProfile
+{
+    std::string         npcId;                // unique ID
+    std::string         displayName;          // optional, for debugging
+    SpeakerSocialRole   role = SpeakerSocialRole::Villager;
+
+    // Style sliders (0..1)
+    float                verbosity01 = 0.4f;       // higher = longer sentences
+    float                superstition01 = 0.8f;    // higher = more taboos, spirits
+    float                bureaucratic01 = 0.0f;    // higher = drier, official tone
+    float                religiosity01 = 0.3f;
+    float                cruelty01 = 0.2f;         // matter‑of‑fact cruelty
+    float                unreliability01 = 0.4f;   // chance to lie or distort
+    float                fatalism01 = 0.7f;        // resigned, hopeless vibe
+
+    // Vocabulary knobs
+    std::string          dialectTag;              // e.g., "rural_east", "block_1988"
+    std::vector<std::string> personalMotifs;      // e.g., "debts", "missing_children"
+
+    // Internal cooldowns (per function, indexed by DialogueFunction), in seconds
+    std::array<float, kDialogueFunctionCount> cooldownSeconds =
+    {
+        20.0f,  // NeutralAmbient
+        15.0f,  // Dread
+        25.0f,  // Misdirection
+        45.0f,  // RitualHint
+        40.0f,  // Rumor
+        35.0f,  // Bureaucratic
+         5.0f,  // ThreatBark
+         3.0f,  // Pain
+         8.0f   // Surprise
+    };
+
+    float& Cooldown(DialogueFunction fn) { return cooldownSeconds[static_cast<std::size_t>(fn)]; }
+    float  Cooldown(DialogueFunction fn) const { return cooldownSeconds[static_cast<std::size_t>(fn)]; }
+};
+
+// Voice sliders in NPCVoiceOverrides::Slider order.
+constexpr float NPCVoiceProfile::* kVoiceSliderFields[] = {
+    &NPCVoiceProfile::verbosity01,
+    &NPCVoiceProfile::superstition01,
+    &NPCVoiceProfile::bureaucratic01,
+    &NPCVoiceProfile::religiosity01,
+    &NPCVoiceProfile::cruelty01,
+    &NPCVoiceProfile::unreliability01,
+    &NPCVoiceProfile::fatalism01
+};
+
+// Compact per-NPC differences from an archetype voice (see
+// DialogueSystem::SpawnNPC). Only sliders whose bit is set in `mask`, and
+// the role if hasRole, replace the archetype's values.
+struct NPCVoiceOverrides
+{
+    enum Slider : uint8_t
+    {
+        Verbosity,
+        Superstition,
+        Bureaucratic,
+        Religiosity,
+        Cruelty,
+        Unreliability,
+        Fatalism,
+        kSliderCount
+    };
+
+    std::array<float, kSliderCount> values = {};
+    uint8_t           mask = 0;
+    bool              hasRole = false;
+    SpeakerSocialRole role = SpeakerSocialRole::Villager;
+
+    NPCVoiceOverrides& Set(Slider slider, float value01)
+    {
+        values[slider] = value01;
+        mask = static_cast<uint8_t>(mask | (1u << slider));
+        return *this;
+    }
+
+    NPCVoiceOverrides& SetRole(SpeakerSocialRole r)
+    {
+        role = r;
+        hasRole = true;
+        return *this;
+    }
+
+    bool Empty() const { return mask == 0 && !hasRole; }
+
+    void ApplyTo(NPCVoiceProfile& voice) const
+    {
+        for (unsigned i = 0; i < kSliderCount; ++i)
+        {
+            if (mask & (1u << i))
+                voice.*kVoiceSliderFields[i] = values[i];
+        }
+        if (hasRole)
+            voice.role = role;
+    }
+};
+
+// ------------------------------------------------------
+// Trigger rules
+// ------------------------------------------------------
+// A trigger maps to a function through an ordered rule list; the first
+// rule whose test passes wins. Lists usually end with an Always rule.
+struct TriggerRule
+{
+    // Sliders first, in NPCVoiceOverrides::Slider order, then context.
+    enum class Input : uint8_t
+    {
+        Verbosity,
+        Superstition,
+        Bureaucratic,
+        Religiosity,
+        Cruelty,
+        Unreliability,
+        Fatalism,
+        ThreatLevel,
+        IsIndoors,
+        IsNight,
+        PlayerRecentlyBrokeTaboo,
+        PlayerLowHealth,
+        PlayerIsBleeding,
+        InSafeRoom,
+        KnownRumorCount,    // distinct: context, fresh region events, diffused
+        Always              // always 1
+    };
+
+    enum class Compare : uint8_t
+    {
+        Greater,
+        GreaterEqual,
+        Less,
+        LessEqual
+    };
+
+    Input            input = Input::Always;
+    Compare          compare = Compare::Greater;
+    float            threshold = 0.0f;
+    DialogueFunction function = DialogueFunction::NeutralAmbient;
+};
+
+constexpr std::size_t kTriggerInputCount = 16;
+
+// ------------------------------------------------------
+// Token resolvers
+// ------------------------------------------------------
+// A "{NAME}" token in template text is identified by the hash of NAME, so
+// IDs can be computed at compile time: TokenId("PLACE").
+constexpr uint64_t TokenId(std::string_view name)
+{
+    return StableHash64(name);
+}
+
+constexpr uint64_t kTokenPlayerCallsign = TokenId("PLAYER_CALLSIGN");
+constexpr uint64_t kTokenLocalSpirit    = TokenId("LOCAL_SPIRIT");
+constexpr uint64_t kTokenTaboo          = TokenId("TABOO");
+constexpr uint64_t kTokenPlace          = TokenId("PLACE");
+constexpr uint64_t kTokenBodySymptom    = TokenId("BODYSYMPTOM");
+
+struct TokenResolveContext
+{
+    const PackedDialogueContext& ctx;
+    const NPCVoiceProfile&       profile;
+    void*                        userData;   // as passed to RegisterTokenResolver
+    const IdInterner&            ids;        // names of the IDs in `ctx`
+};
+
+// Returns the token's text. The view must stay valid until the line is
+// written (static storage or memory owned through userData).
+using TokenResolver = std::string_view (*)(const TokenResolveContext&);
+
+// ------------------------------------------------------
+// Style passes
+// ------------------------------------------------------
+// Style passes don't touch the text. They record prefix/suffix/truncate
+// edits against the line's spans (prefix | body | suffix), and the edits
+// are applied once while the line is written.
+enum class StyleEditKind : uint8_t
+{
+    Prefix,           // written before the body
+    Suffix,           // written after the body, in recorded order
+    TruncateBody,     // cut the body to `limit` bytes at a word/UTF-8 boundary;
+                      // `text` is appended only if a cut happened
+    SoftenFinalStop   // turn a trailing '.' into a space before later suffixes
+};
+
+struct StyleEdit
+{
+    StyleEditKind    kind = StyleEditKind::Suffix;
+    std::string_view text;
+    uint32_t         limit = 0;
+};
+
+struct StylePlan
+{
+    static constexpr std::size_t kMaxEdits = 8;
+
+    std::array<StyleEdit, kMaxEdits> edits;
+    std::size_t                      count = 0;
+
+    void Add(StyleEditKind kind, std::string_view text = {}, uint32_t limit = 0)
+    {
+        if (count < kMaxEdits)
+            edits[count++] = StyleEdit{ kind, text, limit };
+    }
+};
+
+// Hands out the bits of a single 64-bit draw to the style passes of a line.
+// Runs past 64 bits re-mix the word instead of drawing again.
+class StyleDraw
+{
+public:
+    explicit StyleDraw(uint64_t word) : bits(word) {}
+
+    bool Chance(float p)
+    {
+        return static_cast<float>(Take(12)) < p * 4096.0f;
+    }
+
+    uint32_t Pick(uint32_t n)
+    {
+        return static_cast<uint32_t>((Take(8) * n) >> 8);
+    }
+
+private:
+    uint64_t Take(unsigned n)
+    {
+        if (used + n > 64)
+        {
+            bits = RNG::Mix64(bits);
+            used = 0;
+        }
+        const uint64_t v = (bits >> used) & ((1ull << n) - 1);
+        used += n;
+        return v;
+    }
+
+    uint64_t bits;
+    unsigned used = 0;
+};
+
+using StylePass = void (*)(const NPCVoiceProfile&, DialogueFunction, StyleDraw&, StylePlan&);
+
+// ------------------------------------------------------
+// Dialogue template definition
+// ------------------------------------------------------
+//
+// What a template condition sees. The Has* helpers test the context for
+// a name; a name the system never saw is never present.
+struct DialogueConditionContext
+{
+    const PackedDialogueContext& ctx;
+    const NPCVoiceProfile&       profile;
+    const IdInterner&            ids;        // names of the IDs in `ctx`
+
+    bool HasTaboo(const std::string& id) const { return ctx.tabooIds.Contains(ids.Find(id)); }
+    bool HasEvent(const std::string& id) const { return ctx.eventIds.Contains(ids.Find(id)); }
+    bool KnowsRumor(const std::string& id) const { return ctx.rumorIds.Contains(ids.Find(id)); }
+
+    bool AtLocation(const std::string& id) const
+    {
+        return ctx.locationId != IdInterner::kInvalid && ctx.locationId == ids.Find(id);
+    }
+};
+
+// Text uses simple tokens that get replaced at runtime:
+//   {PLAYER_CALLSIGN}, {LOCAL_SPIRIT}, {TABOO}, {PLACE}, {BODYSYMPTOM}, and
+//   any token added through DialogueSystem::RegisterTokenResolver.
+// The "weight" field is used for RNG selection.
+//
+struct DialogueTemplate
+{
+    std::string                 id;
+    DialogueFunction            function = DialogueFunction::NeutralAmbient;
+    ReliabilityTag              reliability = ReliabilityTag::Unknown;
+    RegionTone                  regionTone = RegionTone::ForestVillage;
+
+    // Optional tags (used as soft filters)
+    std::vector<std::string>   requiredTabooIds;
+    std::vector<std::string>   requiredEventIds;
+    std::vector<std::string>   disallowedLocationIds;
+    std::vector<SpeakerSocialRole> allowedRoles;
+
+    // Short template text (one line). Slavic‑horror tone is controlled via content.
+    std::string                 text;
+    float                       weight = 1.0f;
+
+    // Conditions as lambdas (can be set at data load time)
+    std::function<bool(const DialogueConditionContext&)> condition;
+};
+
+// Output of the buffer-writing GenerateLine overloads. `text` points into
+// the caller's buffer (or the thread's arena) and `templateId` into the
+// system's template store.
+struct DialogueLineResult
+{
+    std::string_view text;
+    std::string_view templateId;
+    ReliabilityTag   reliability = ReliabilityTag::Unknown;
+    DialogueFunction function = DialogueFunction::NeutralAmbient;
+    bool             truncated = false;   // line did not fit the buffer
+
+    explicit operator bool() const { return !text.empty(); }
+};
+
+// Per-thread scratch storage for GenerateLine results; a result's text
+// stays valid until the next call on the same thread.
+struct DialogueLineArena
+{
+    static constexpr std::size_t kCapacity = 4096;
+
+    std::array<char, kCapacity> bytes;
+
+    static DialogueLineArena& ForCurrentThread()
+    {
+        thread_local DialogueLineArena arena;
+        return arena;
+    }
+};
+
+// Dense index of a registered NPC, assigned by RegisterNPCProfile. NPC
+// state (cooldowns, recency, weight scales) lives in flat arrays indexed
+// by it. Slots are reused after UnregisterNPCProfile; the generation
+// tells a stale handle from the slot's new owner.
+struct NPCHandle
+{
+    static constexpr uint32_t kInvalid = 0xFFFFFFFFu;
+
+    uint32_t index = kInvalid;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return index != kInvalid; }
+    bool operator==(NPCHandle o) const { return index == o.index && generation == o.generation; }
+    bool operator!=(NPCHandle o) const { return !(*this == o); }
+};
+
+// Dense ID of an interned trigger tag (DialogueSystem::InternTrigger).
+// ID 0 is the unknown trigger, which picks a function from the mood.
+struct TriggerId
+{
+    uint32_t index = 0;
+
+    bool operator==(TriggerId o) const { return index == o.index; }
+    bool operator!=(TriggerId o) const { return index != o.index; }
+};
+
+// Directed social tie for rumor diffusion: each step, `speaker` talks to
+// `listener` with probability talkChance01.
+struct SocialEdge
+{
+    NPCHandle speaker;
+    NPCHandle listener;
+    float     talkChance01 = 0.1f;
+};
+
+// "NPC may use this function again" notification; see
+// DialogueSystem::GetCooldownExpiries.
+struct CooldownExpiry
+{
+    NPCHandle        npc;
+    DialogueFunction function = DialogueFunction::NeutralAmbient;
+    double           readySeconds = 0.0;
+};
+
+// Context captured for deferred lines; see DialogueSystem::SnapshotContext.
+using ContextSnapshotId = uint32_t;
+
+// A line that was selected (cooldowns, recency and RNG already advanced)
+// but not yet written. Realizing it later produces the same text that
+// GenerateLine would have produced at selection time. Handles go stale
+// when templates are removed, context snapshots are released or the
+// speaker's voice changes (re-registered, re-spawned, archetype edited).
+struct DeferredDialogueLine
+{
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    uint32_t               templateIndex = kNone;
+    uint32_t               templateEpoch = 0;
+    ContextSnapshotId      contextSnapshot = kNone;
+    uint32_t               snapshotEpoch = 0;
+    RNG                    rng;                    // stream state after selection
+    DialogueFunction       function = DialogueFunction::NeutralAmbient;
+    NPCHandle              speaker;
+    uint64_t               voiceVersion = 0;       // speaker's voice at selection
+
+    explicit operator bool() const { return templateIndex != kNone; }
+};
+
+// One line produced by DialogueSystem::FlushTriggerQueue.
+struct QueuedDialogueLine
+{
+    NPCHandle          npc;
+    TriggerId          trigger;
+    DialogueLineResult result;     // empty if nothing fit (or on cooldown)
+};
+
+// ------------------------------------------------------
+// Session record / replay
+// ------------------------------------------------------
+// State-changing calls made while recording, in order. Replaying them into
+// a system with the same setup (templates, resolvers, style passes,
+// policies, and the NPCs, archetypes and throttle groups that existed
+// when recording started) reproduces every line. Queued triggers are
+// logged as the GenerateLine entries their flush produces.
+struct DialogueReplayEntry
+{
+    enum class Kind
+    {
+        GenerateLine,
+        DeferLine,
+        SetTabooActive,
+        SetEventActive,
+        NotifyEvent,
+        SeedRumor,
+        StepRumors,
+        SetTemplateWeightScale,
+        SetNPCTemplateWeightScale,
+        RegisterNPCProfile,
+        RegisterArchetype,
+        SpawnNPC,
+        UnregisterNPC,
+        CreateThrottleGroup,
+        SetThrottle,
+        AssignThrottleGroups,
+        SetTriggerRules,
+        SetSocialGraph,
+        SetRumorDiffusionPolicy,
+        DeclareContextId
+    };
+
+    struct SocialTie
+    {
+        std::string speaker;
+        std::string listener;
+        float       talkChance01 = 0.0f;
+    };
+
+    Kind            kind = Kind::GenerateLine;
+    double          timeSeconds = 0.0;
+    std::string     npcId;
+    std::string     triggerTag;
+    std::string     regionId;
+    std::string     id;                  // taboo / event / template / archetype / declared ID
+    float           value = 0.0f;        // severity or weight scale
+    bool            active = false;      // also: seeded rumor is distorted
+    uint64_t        triggerSequence = 0; // also: rumor step index
+    DialogueContext ctx;
+    FallbackLadder  fallback;
+    std::string     line;                // recorded output (template ID for DeferLine)
+
+    NPCVoiceProfile          profile;    // RegisterNPCProfile / RegisterArchetype
+    NPCVoiceOverrides        overrides;  // SpawnNPC
+    std::vector<TriggerRule> rules;      // SetTriggerRules
+    ThrottleGroupId          squadGroup = kNoThrottleGroup;   // also: created / SetThrottle group
+    ThrottleGroupId          regionGroup = kNoThrottleGroup;
+    DialogueFunction         function = DialogueFunction::NeutralAmbient;
+    BarkThrottle             throttle;
+    std::vector<SocialTie>   ties;       // SetSocialGraph, by npcId
+    RumorDiffusionPolicy     rumorPolicy;
+};
+
+struct DialogueSessionLog
+{
+    uint64_t                         sessionSeed = 0;
+    std::vector<DialogueReplayEntry> entries;
+};
+
+// ------------------------------------------------------
+// DialogueSystem core
+// ------------------------------------------------------
+class DialogueSystem
+{
+public:
+    DialogueSystem()
+    {
+        std::random_device rd;
+        sessionSeed = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+        SetRecencyPolicy(RecencyPolicy());
+        RegisterDefaultTokenResolvers();
+        RegisterDefaultStylePasses();
+        RegisterDefaultTriggers();
+        InitializeDefaultTemplates();
+    }
+
+    // Call this each frame or tick with global time (seconds). Also
+    // advances the cooldown wheel; see GetCooldownExpiries.
+    void SetCurrentTimeSeconds(double t)
+    {
+        currentTimeSeconds = t;
+        cooldownExpiries.clear();
+        cooldownWheel.Advance(t, [this](uint64_t payload, double readySeconds)
+        {
+            const auto index = static_cast<uint32_t>(payload >> 8);
+            const auto fn = static_cast<DialogueFunction>(payload & 0xFF);
+
+            // Skip timers of despawned NPCs (the payload only keeps the low
+            // generation bits) or superseded by a later TouchCooldown.
+            if (index >= npcs.size() || !npcs[index].alive ||
+                (npcs[index].handle.generation & kTimerGenerationMask) != (payload >> 40))
+                return;
+            const NPCHandle handle = npcs[index].handle;
+            if (npcReadyAtSeconds[CooldownSlot(handle, fn)] != readySeconds)
+                return;
+            MarkReady(handle, fn);
+            cooldownExpiries.push_back(CooldownExpiry{ handle, fn, readySeconds });
+        });
+        eventExpiryWheel.Advance(t, [this](uint64_t payload, double expiresSeconds)
+        {
+            const auto regionId = static_cast<uint32_t>(payload >> 32);
+            const auto eventId = static_cast<uint32_t>(payload);
+            RegionLiveState* region = regionId < regionByContextId.size() ? regionByContextId[regionId] : nullptr;
+            if (!region)
+                return;
+
+            // Skip timers superseded by a later NotifyEvent or SetEventActive.
+            auto it = region->notifiedEventExpiry.find(eventId);
+            if (it == region->notifiedEventExpiry.end() || it->second != expiresSeconds)
+                return;
+            region->notifiedEventExpiry.erase(it);
+            SetRegionEventActive(*region, eventId, false);
+        });
+        SweepStaleState(sweepPolicy.itemsPerTick);
+    }
+
+    void SetSweepPolicy(const SweepPolicy& policy)
+    {
+        sweepPolicy = policy;
+    }
+
+    // Cooldowns that expired during the last SetCurrentTimeSeconds step,
+    // in tick order. AI can schedule barks from these instead of
+    // polling GenerateLine.
+    const std::vector<CooldownExpiry>& GetCooldownExpiries() const
+    {
+        return cooldownExpiries;
+    }
+
+    // NPCs whose cooldown for `fn` has expired (throttles and candidate
+    // availability are not considered). Unordered.
+    const std::vector<NPCHandle>& GetReadyNPCs(DialogueFunction fn) const
+    {
+        return readyNPCs[static_cast<std::size_t>(fn)];
+    }
+
+    // Every line is drawn from a stream keyed by (session seed, NPC,
+    // per-NPC trigger sequence), so a fixed seed makes sessions
+    // reproducible and NPCs never share generator state.
+    void SetSessionSeed(uint64_t seed)
+    {
+        sessionSeed = seed;
+    }
+
+    uint64_t GetSessionSeed() const
+    {
+        return sessionSeed;
+    }
+
+    // For an exact replay, record from the state ReplaySession starts
+    // from: call ResetSessionState first (or record from a fresh system).
+    void StartRecording()
+    {
+        sessionLog = DialogueSessionLog();
+        sessionLog.sessionSeed = sessionSeed;
+        recording = true;
+    }
+
+    void StopRecording()
+    {
+        recording = false;
+    }
+
+    const DialogueSessionLog& GetSessionLog() const
+    {
+        return sessionLog;
+    }
+
+    // Runtime state a session builds up: cooldowns and their timers,
+    // recency windows, throttle tokens, tracked regions (live sets, event
+    // rings, snapshots), rumor knowledge and the diffusion step, queued
+    // triggers and context snapshots. Setup (templates, NPCs, archetypes,
+    // throttle limits, weight scales, the social graph, policies) is kept.
+    void ResetSessionState()
+    {
+        cooldownWheel = TimingWheel();
+        cooldownExpiries.clear();
+        globalRecent.Clear();
+        for (NPCRecord& npc : npcs)
+        {
+            if (!npc.alive)
+                continue;
+            ReleaseRecent(npc);
+            npc.lastActiveSeconds = 0.0;
+            npc.triggerSequence = 0;
+            for (std::size_t f = 0; f < kDialogueFunctionCount; ++f)
+            {
+                npcReadyAtSeconds[CooldownSlot(npc.handle, static_cast<DialogueFunction>(f))] =
+                    -std::numeric_limits<double>::infinity();
+                MarkReady(npc.handle, static_cast<DialogueFunction>(f));
+            }
+        }
+
+        for (ThrottleBucket& bucket : throttleBuckets)
+        {
+            bucket.tokens = bucket.limit.burst;
+            bucket.lastRefillSeconds = currentTimeSeconds;
+        }
+
+        regions.clear();
+        regionByContextId.clear();
+        eventExpiryWheel = TimingWheel();
+
+        rumorDiffusion.ClearKnowledge();
+        rumorStep = 0;
+
+        for (std::deque<QueuedTrigger>& bucket : triggerQueue)
+            bucket.clear();
+        queuedTriggerKeys.clear();
+        queuedTriggerCount = 0;
+        ReleaseContextSnapshots();
+    }
+
+    // True if the entry's NPC is about to run at its recorded trigger
+    // sequence; a drift means an extra, missing or reordered call.
+    bool ReplaySequenceMatches(const DialogueReplayEntry& e) const
+    {
+        const NPCRecord* npc = FindNPCRecord(e.npcId);
+        return npc && npc->triggerSequence == e.triggerSequence;
+    }
+
+    // Resets session state, re-applies a recorded session and returns how
+    // many GenerateLine / DeferLine entries produced a different result
+    // than recorded, or ran at a different per-NPC trigger sequence
+    // (0 = exact replay).
+    std::size_t ReplaySession(const DialogueSessionLog& log)
+    {
+        const bool wasRecording = recording;
+        recording = false;
+        sessionSeed = log.sessionSeed;
+        ResetSessionState();
+
+        std::size_t mismatches = 0;
+        for (const DialogueReplayEntry& e : log.entries)
+        {
+            SetCurrentTimeSeconds(e.timeSeconds);
+            switch (e.kind)
+            {
+                case DialogueReplayEntry::Kind::GenerateLine:
+                {
+                    const bool inSequence = ReplaySequenceMatches(e);
+                    if (GenerateLine(e.npcId, e.triggerTag, e.ctx, e.fallback) != e.line || !inSequence)
+                        ++mismatches;
+                    break;
+                }
+                case DialogueReplayEntry::Kind::DeferLine:
+                {
+                    const bool inSequence = ReplaySequenceMatches(e);
+                    const DeferredDialogueLine d = GenerateLineDeferred(e.npcId, e.triggerTag,
+                                                                        SnapshotContext(e.ctx), e.fallback);
+                    if ((d ? std::string_view(templates[d.templateIndex].id) : std::string_view()) != e.line || !inSequence)
+                        ++mismatches;
+                    break;
+                }
+                case DialogueReplayEntry::Kind::SetTabooActive:
+                    SetTabooActive(e.regionId, e.id, e.active);
+                    break;
+                case DialogueReplayEntry::Kind::SetEventActive:
+                    SetEventActive(e.regionId, e.id, e.active);
+                    break;
+                case DialogueReplayEntry::Kind::NotifyEvent:
+                    NotifyEvent(e.id, e.regionId, e.value);
+                    break;
+                case DialogueReplayEntry::Kind::SeedRumor:
+                    SeedRumor(FindNPC(e.npcId), e.id, e.active);
+                    break;
+                case DialogueReplayEntry::Kind::StepRumors:
+                    rumorStep = e.triggerSequence;
+                    StepRumors();
+                    break;
+                case DialogueReplayEntry::Kind::SetSocialGraph:
+                {
+                    std::vector<SocialEdge> edges;
+                    edges.reserve(e.ties.size());
+                    for (const DialogueReplayEntry::SocialTie& tie : e.ties)
+                        edges.push_back(SocialEdge{ FindNPC(tie.speaker), FindNPC(tie.listener), tie.talkChance01 });
+                    SetSocialGraph(edges);
+                    break;
+                }
+                case DialogueReplayEntry::Kind::SetRumorDiffusionPolicy:
+                    SetRumorDiffusionPolicy(e.rumorPolicy);
+                    break;
+                case DialogueReplayEntry::Kind::DeclareContextId:
+                    DeclareContextIds({ e.id });
+                    break;
+                case DialogueReplayEntry::Kind::SetTemplateWeightScale:
+                    SetTemplateWeightScale(e.id, e.value);
+                    break;
+                case DialogueReplayEntry::Kind::SetNPCTemplateWeightScale:
+                    SetNPCTemplateWeightScale(e.npcId, e.id, e.value);
+                    break;
+                case DialogueReplayEntry::Kind::RegisterNPCProfile:
+                    RegisterNPCProfile(e.profile);
+                    break;
+                case DialogueReplayEntry::Kind::RegisterArchetype:
+                    RegisterArchetype(e.id, e.profile);
+                    break;
+                case DialogueReplayEntry::Kind::SpawnNPC:
+                    SpawnNPC(e.npcId, e.id, e.overrides);
+                    break;
+                case DialogueReplayEntry::Kind::UnregisterNPC:
+                    UnregisterNPCProfile(e.npcId);
+                    break;
+                case DialogueReplayEntry::Kind::CreateThrottleGroup:
+                    while (throttleBuckets.size() / kDialogueFunctionCount <= e.squadGroup)
+                        CreateThrottleGroup();
+                    break;
+                case DialogueReplayEntry::Kind::SetThrottle:
+                    SetThrottle(e.squadGroup, e.function, e.throttle);
+                    break;
+                case DialogueReplayEntry::Kind::AssignThrottleGroups:
+                    AssignNPCThrottleGroups(FindNPC(e.npcId), e.squadGroup, e.regionGroup);
+                    break;
+                case DialogueReplayEntry::Kind::SetTriggerRules:
+                    SetTriggerRules(e.triggerTag, e.rules);
+                    break;
+            }
+        }
+
+        recording = wasRecording;
+        return mismatches;
+    }
+
+    void SetSamplingMode(SamplingMode mode)
+    {
+        samplingMode = mode;
+    }
+
+    void SetRecencyPolicy(const RecencyPolicy& policy)
+    {
+        recencyPolicy = policy;
+        globalRecent.Configure(policy.globalWindowPicks, policy.globalWindowSeconds);
+        for (RecencyWindow<8>& window : npcRecent)
+            window.Configure(policy.npcWindowPicks, policy.npcWindowSeconds);
+    }
+
+    // Registers (or updates) an NPC with its own full profile and returns
+    // its dense handle. Re-registering keeps the handle and the NPC's
+    // cooldown timers. Prefer archetypes + SpawnNPC for crowds.
+    NPCHandle RegisterNPCProfile(const NPCVoiceProfile& profile)
+    {
+        if (recording)
+            RecordEntry(DialogueReplayEntry::Kind::RegisterNPCProfile).profile = profile;
+
+        const NPCHandle existing = FindNPC(profile.npcId);
+        uint32_t voiceIndex;
+        if (existing && voices[npcs[existing.index].voiceIndex].kind == VoiceKind::Private &&
+            voices[npcs[existing.index].voiceIndex].users == 1)
+        {
+            voiceIndex = npcs[existing.index].voiceIndex;
+            *voices[voiceIndex].profile = profile;
+            voices[voiceIndex].version = ++voiceVersion;
+        }
+        else
+        {
+            voiceIndex = AddVoice(VoiceKind::Private, profile);
+        }
+        return BindNPC(profile.npcId, voiceIndex);
+    }
+
+    // Archetypes are shared voices ("villager_old", "militia_conscript")
+    // that many NPCs point at. Replacing one updates every NPC spawned
+    // from it.
+    void RegisterArchetype(const std::string& archetypeId, const NPCVoiceProfile& voice)
+    {
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::RegisterArchetype);
+            e.id = archetypeId;
+            e.profile = voice;
+        }
+
+        auto it = archetypeIndexById.find(archetypeId);
+        if (it == archetypeIndexById.end())
+        {
+            const uint32_t index = AddVoice(VoiceKind::Archetype, voice);
+            voices[index].profile->npcId = archetypeId;
+            archetypeIndexById.emplace(archetypeId, index);
+            return;
+        }
+
+        const uint32_t index = it->second;
+        *voices[index].profile = voice;
+        voices[index].profile->npcId = archetypeId;
+        voices[index].version = ++voiceVersion;
+        for (VoiceRecord& v : voices)
+        {
+            if (!v.profile || v.kind != VoiceKind::Variant || v.base != index)
+                continue;
+            *v.profile = voice;
+            v.profile->npcId = archetypeId;
+            v.overrides.ApplyTo(*v.profile);
+            v.version = ++voiceVersion;
+        }
+        for (NPCRecord& npc : npcs)
+        {
+            if (npc.alive && voices[npc.voiceIndex].base == index)
+                RefreshNPCVoice(npc);
+        }
+    }
+
+    bool HasArchetype(const std::string& archetypeId) const
+    {
+        return archetypeIndexById.count(archetypeId) > 0;
+    }
+
+    // Creates (or rebinds) an NPC that shares an archetype's voice. NPCs
+    // with identical overrides share one voice variant. A spawned NPC
+    // costs a ~100-byte NPCRecord, 16 bytes of cooldown state per
+    // function and its npcHandleById entry; the recency window (~320
+    // bytes) is added on its first pick and per-NPC weights only by
+    // SetNPCTemplateWeightScale.
+    NPCHandle SpawnNPC(const std::string& npcId,
+                       const std::string& archetypeId,
+                       const NPCVoiceOverrides& overrides = NPCVoiceOverrides())
+    {
+        auto it = archetypeIndexById.find(archetypeId);
+        if (it == archetypeIndexById.end())
+            return NPCHandle();
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SpawnNPC);
+            e.npcId = npcId;
+            e.id = archetypeId;
+            e.overrides = overrides;
+        }
+
+        const uint32_t voiceIndex = overrides.Empty()
+            ? it->second
+            : AcquireVoiceVariant(it->second, overrides);
+        return BindNPC(npcId, voiceIndex);
+    }
+
+    // Frees the NPC's slot, cooldowns, pending timers and private voice.
+    // Its handle (and deferred lines spoken by it) stop resolving.
+    bool UnregisterNPCProfile(const std::string& npcId)
+    {
+        return UnregisterNPCProfile(FindNPC(npcId));
+    }
+
+    bool UnregisterNPCProfile(NPCHandle handle)
+    {
+        NPCRecord* npc = ResolveNPC(handle);
+        if (!npc)
+            return false;
+
+        if (recording)
+            RecordEntry(DialogueReplayEntry::Kind::UnregisterNPC).npcId = *npc->npcId;
+
+        for (std::size_t f = 0; f < kDialogueFunctionCount; ++f)
+        {
+            MarkNotReady(handle, static_cast<DialogueFunction>(f));
+            npcReadyAtSeconds[CooldownSlot(handle, static_cast<DialogueFunction>(f))] =
+                -std::numeric_limits<double>::infinity();
+        }
+        ReleaseVoice(npc->voiceIndex);
+        npcHandleById.erase(*npc->npcId);
+        rumorDiffusion.ClearNPC(handle.index, true);
+        ReleaseRecent(*npc);
+
+        // Fresh record: drops the per-NPC weights and their heap storage.
+        const uint32_t nextGeneration = npc->handle.generation + 1;
+        *npc = NPCRecord();
+        npc->handle = NPCHandle{ handle.index, nextGeneration };
+        RefreshDistortThreshold(*npc);
+        freeNPCSlots.push_back(handle.index);
+        return true;
+    }
+
+    std::size_t GetNPCCount() const
+    {
+        return npcHandleById.size();
+    }
+
+    NPCHandle FindNPC(const std::string& npcId) const
+    {
+        auto it = npcHandleById.find(npcId);
+        return it != npcHandleById.end() ? it->second : NPCHandle();
+    }
+
+    // The NPC's effective voice. For spawned NPCs this is the shared
+    // archetype (or variant) voice, whose npcId is the archetype ID.
+    const NPCVoiceProfile* GetNPCProfile(const std::string& npcId) const
+    {
+        return GetNPCProfile(FindNPC(npcId));
+    }
+
+    const NPCVoiceProfile* GetNPCProfile(NPCHandle handle) const
+    {
+        const NPCRecord* npc = ResolveNPC(handle);
+        return npc ? npc->voice : nullptr;
+    }
+
+    // Adds a template, or replaces the one with the same id (reload).
+    // Static eligibility lists are patched incrementally.
+    void AddTemplate(const DialogueTemplate& t)
+    {
+        auto it = templateIndexById.find(t.id);
+        if (it != templateIndexById.end())
+            RemoveTemplateAt(it->second);
+
+        const uint32_t index = static_cast<uint32_t>(templates.size());
+        templates.push_back(t);
+        compiledTemplates.push_back(CompileTemplate(t));
+        weightScales.push_back(1.0f);
+        templateIndexById[t.id] = index;
+
+        IndexTemplateDependencies(index);
+        for (auto& set : eligibilitySets)
+            InsertIntoEligibility(*set, index);
+        for (auto& kv : regions)
+            InsertIntoRegion(kv.second, index);
+    }
+
+    bool RemoveTemplate(const std::string& templateId)
+    {
+        auto it = templateIndexById.find(templateId);
+        if (it == templateIndexById.end())
+            return false;
+
+        RemoveTemplateAt(it->second);
+        return true;
+    }
+
+    // Adds or replaces the resolver for "{name}". New names re-tokenize the
+    // loaded templates; realization cost only depends on the tokens a
+    // line actually contains. A null resolver is rejected.
+    bool RegisterTokenResolver(std::string_view name,
+                               TokenResolver resolver,
+                               void* userData = nullptr)
+    {
+        if (!resolver)
+            return false;
+
+        const uint64_t id = TokenId(name);
+        auto it = resolverSlotById.find(id);
+        if (it != resolverSlotById.end())
+        {
+            TokenResolverEntry& entry = tokenResolvers[it->second];
+            if (entry.name != name)
+                return false; // hash collision with another token name
+            entry.resolver = resolver;
+            entry.userData = userData;
+            return true;
+        }
+
+        resolverSlotById[id] = static_cast<uint16_t>(tokenResolvers.size());
+        tokenResolvers.push_back({ std::string(name), resolver, userData });
+
+        for (uint32_t i = 0; i < templates.size(); ++i)
+            TokenizeText(templates[i].text, compiledTemplates[i]);
+        return true;
+    }
+
+    // Style passes run in registration order; each may record edits for
+    // the line being written.
+    void AddStylePass(StylePass pass)
+    {
+        stylePasses.push_back(pass);
+    }
+
+    void ClearStylePasses()
+    {
+        stylePasses.clear();
+    }
+
+    // Runtime weight modulation (director pacing, damping after use, ...).
+    // Effective weight = template weight * global scale * per-NPC scale;
+    // DialogueTemplate::weight itself is never modified. A global change
+    // invalidates per-NPC trees of the affected buckets, which rebuild on
+    // their next pick.
+    bool SetTemplateWeightScale(const std::string& templateId, float scale)
+    {
+        auto it = templateIndexById.find(templateId);
+        if (it == templateIndexById.end())
+            return false;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetTemplateWeightScale);
+            e.id = templateId;
+            e.value = scale;
+        }
+
+        const uint32_t index = it->second;
+        weightScales[index] = scale;
+        for (auto& set : eligibilitySets)
+        {
+            for (auto& bucket : set->buckets[static_cast<std::size_t>(templates[index].function)])
+                UpdateBucketWeight(bucket, index);
+        }
+        return true;
+    }
+
+    bool SetNPCTemplateWeightScale(const std::string& npcId,
+                                   const std::string& templateId,
+                                   float scale)
+    {
+        NPCRecord* npc = FindNPCRecord(npcId);
+        auto it = templateIndexById.find(templateId);
+        if (!npc || it == templateIndexById.end())
+            return false;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetNPCTemplateWeightScale);
+            e.npcId = npcId;
+            e.id = templateId;
+            e.value = scale;
+        }
+
+        const uint32_t index = it->second;
+        if (!npc->weights)
+            npc->weights = std::make_unique<NPCWeightOverrides>();
+        npc->weights->scales[index] = scale;
+        for (auto& bucket : npc->eligibility->buckets[static_cast<std::size_t>(templates[index].function)])
+        {
+            auto slot = bucket.slotOf.find(index);
+            const bool member = bucket.dirty
+                ? std::find(bucket.indices.begin(), bucket.indices.end(), index) != bucket.indices.end()
+                : slot != bucket.slotOf.end();
+            if (!member)
+                continue;
+
+            // Up-to-date trees take an O(log n) update; anything else is
+            // (re)built on the next pick from this bucket.
+            NPCBucketWeights& weights = npc->weights->buckets[&bucket];
+            if (!bucket.dirty && weights.version == bucket.weightVersion)
+                weights.tree.Set(slot->second, EffectiveWeight(index, *npc));
+            else
+                weights.version = kStaleWeights;
+        }
+        return true;
+    }
+
+    // Main API used by AI / scripts.
+    // "triggerTag" can be something like "on_enter_safehouse",
+    // "on_player_breaks_taboo", "on_night_heartbeat", "on_enemy_spotted", etc.
+    std::string GenerateLine(const std::string& npcId,
+                             const std::string& triggerTag,
+                             const DialogueContext& ctx)
+    {
+        return GenerateLine(npcId, triggerTag, ctx, FallbackLadder());
+    }
+
+    // Same as above, but if the mapped function has no candidate (or is on
+    // cooldown) the ladder's tiers are tried in order. Each tier only visits
+    // its own function bucket, so the whole ladder is at most one pass.
+    std::string GenerateLine(const std::string& npcId,
+                             const std::string& triggerTag,
+                             const DialogueContext& ctx,
+                             const FallbackLadder& fallback)
+    {
+        return GenerateLine(FindNPC(npcId), FindTrigger(triggerTag), PackContextScratch(ctx), fallback);
+    }
+
+    // Allocation-free variants: the line is written into `buffer` (or the
+    // calling thread's arena) and described by the returned result.
+    DialogueLineResult GenerateLine(const std::string& npcId,
+                                    const std::string& triggerTag,
+                                    const DialogueContext& ctx,
+                                    char* buffer,
+                                    std::size_t capacity,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(FindNPC(npcId), FindTrigger(triggerTag), PackContextScratch(ctx), buffer, capacity, fallback);
+    }
+
+    DialogueLineResult GenerateLine(const std::string& npcId,
+                                    const std::string& triggerTag,
+                                    const DialogueContext& ctx,
+                                    DialogueLineArena& arena,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npcId, triggerTag, ctx, arena.bytes.data(), arena.bytes.size(), fallback);
+    }
+
+    // Replaces a trigger's rule list (interning the tag if needed). A
+    // trigger whose rules all fail uses the unknown trigger's rules
+    // (tag ""), which default to picking a function from the mood.
+    void SetTriggerRules(const std::string& triggerTag, const std::vector<TriggerRule>& rules)
+    {
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetTriggerRules);
+            e.triggerTag = triggerTag;
+            e.rules = rules;
+        }
+
+        TriggerEntry& entry = triggerTable[InternTrigger(triggerTag).index];
+        deadTriggerRules += entry.ruleCount;
+        entry.firstRule = static_cast<uint32_t>(triggerRules.size());
+        entry.ruleCount = static_cast<uint32_t>(rules.size());
+        entry.functions = 0;
+        entry.exhaustive = false;
+        entry.readsRumorCount = false;
+        for (const TriggerRule& r : rules)
+        {
+            const CompiledTriggerRule c = CompileTriggerRule(r);
+            triggerRules.push_back(c);
+            if (entry.exhaustive)
+                continue;
+            entry.functions |= FunctionBit(c.function);
+            entry.readsRumorCount |= r.input == TriggerRule::Input::KnownRumorCount;
+            entry.exhaustive = r.input == TriggerRule::Input::Always && RulePasses(c, 1.0f);
+        }
+
+        if (deadTriggerRules > triggerRules.size() / 2)
+            CompactTriggerRules();
+    }
+
+    // Handle-based API. Resolve NPCs with RegisterNPCProfile/SpawnNPC/
+    // FindNPC and triggers with InternTrigger once, then pass the IDs each
+    // frame. Only the PackedDialogueContext (and region snapshot) forms
+    // are free of string hashing; the DialogueContext forms still look up
+    // every taboo, event and rumor name per call. Pack a reused context
+    // once with PackContext or SnapshotContext instead.
+    TriggerId InternTrigger(const std::string& triggerTag)
+    {
+        auto inserted = triggerIdByTag.emplace(triggerTag, TriggerId());
+        if (inserted.second)
+        {
+            inserted.first->second.index = static_cast<uint32_t>(triggerTable.size());
+            triggerTable.push_back(TriggerEntry{ triggerTag });
+        }
+        return inserted.first->second;
+    }
+
+    // Unknown tags map to the unknown trigger (mood-based function).
+    TriggerId FindTrigger(const std::string& triggerTag) const
+    {
+        auto it = triggerIdByTag.find(triggerTag);
+        return it != triggerIdByTag.end() ? it->second : TriggerId();
+    }
+
+    const std::string& GetTriggerTag(TriggerId trigger) const
+    {
+        return triggerTable[trigger.index < triggerTable.size() ? trigger.index : 0].tag;
+    }
+
+    // Convenience forms: pack `ctx` on every call (see above).
+    std::string GenerateLine(NPCHandle npc,
+                             TriggerId trigger,
+                             const DialogueContext& ctx,
+                             const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npc, trigger, PackContextScratch(ctx), fallback);
+    }
+
+    DialogueLineResult GenerateLine(NPCHandle npc,
+                                    TriggerId trigger,
+                                    const DialogueContext& ctx,
+                                    char* buffer,
+                                    std::size_t capacity,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npc, trigger, PackContextScratch(ctx), buffer, capacity, fallback);
+    }
+
+    // Packed-context forms; callers that reuse one context across many
+    // NPCs can pack it once. The std::string forms write through the
+    // thread's arena and realize lines that do not fit again into a
+    // larger buffer, so they never truncate.
+    std::string GenerateLine(NPCHandle npc,
+                             TriggerId trigger,
+                             const PackedDialogueContext& ctx,
+                             const FallbackLadder& fallback = FallbackLadder())
+    {
+        DialogueLineArena& arena = DialogueLineArena::ForCurrentThread();
+        std::string longLine;
+        return std::string(GenerateLineInto(npc, trigger, ctx, arena.bytes.data(), arena.bytes.size(),
+                                            fallback, &longLine).text);
+    }
+
+    DialogueLineResult GenerateLine(NPCHandle handle,
+                                    TriggerId trigger,
+                                    const PackedDialogueContext& ctx,
+                                    char* buffer,
+                                    std::size_t capacity,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLineInto(handle, trigger, ctx, buffer, capacity, fallback, nullptr);
+    }
+
+    DialogueLineResult GenerateLine(NPCHandle npc,
+                                    TriggerId trigger,
+                                    const DialogueContext& ctx,
+                                    DialogueLineArena& arena,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npc, trigger, ctx, arena.bytes.data(), arena.bytes.size(), fallback);
+    }
+
+    // Group throttles. Besides its own cooldowns, a line must fit the
+    // token buckets of the NPC's squad, its region and the global group
+    // for that function. The check runs before candidate selection, so a
+    // throttled trigger costs a few loads; tokens are only taken when a
+    // line is actually picked.
+    ThrottleGroupId CreateThrottleGroup()
+    {
+        const auto id = static_cast<ThrottleGroupId>(throttleBuckets.size() / kDialogueFunctionCount);
+        throttleBuckets.resize(throttleBuckets.size() + kDialogueFunctionCount);
+        if (recording)
+            RecordEntry(DialogueReplayEntry::Kind::CreateThrottleGroup).squadGroup = id;
+        return id;
+    }
+
+    void SetThrottle(ThrottleGroupId group, DialogueFunction fn, const BarkThrottle& limit)
+    {
+        if (group == kNoThrottleGroup || group >= throttleBuckets.size() / kDialogueFunctionCount)
+            return;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetThrottle);
+            e.squadGroup = group;
+            e.function = fn;
+            e.throttle = limit;
+        }
+
+        ThrottleBucket& bucket = throttleBuckets[ThrottleSlot(group, fn)];
+        bucket.limit = limit;
+        bucket.tokens = limit.burst;
+        bucket.lastRefillSeconds = currentTimeSeconds;
+    }
+
+    void SetGlobalThrottle(DialogueFunction fn, const BarkThrottle& limit)
+    {
+        SetThrottle(kGlobalThrottleGroup, fn, limit);
+    }
+
+    // Either group may be kNoThrottleGroup; other IDs must come from
+    // CreateThrottleGroup. A bucket is charged once per line, so a region
+    // equal to the squad (or either equal to the global group) is only
+    // checked once.
+    bool AssignNPCThrottleGroups(NPCHandle handle, ThrottleGroupId squad, ThrottleGroupId region)
+    {
+        NPCRecord* npc = ResolveNPC(handle);
+        const std::size_t groupCount = throttleBuckets.size() / kDialogueFunctionCount;
+        if (!npc ||
+            (squad != kNoThrottleGroup && squad >= groupCount) ||
+            (region != kNoThrottleGroup && region >= groupCount))
+            return false;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::AssignThrottleGroups);
+            e.npcId = *npc->npcId;
+            e.squadGroup = squad;
+            e.regionGroup = region;
+        }
+
+        npc->squadGroup = squad == kGlobalThrottleGroup ? kNoThrottleGroup : squad;
+        npc->regionGroup = (region == kGlobalThrottleGroup || region == squad) ? kNoThrottleGroup : region;
+        return true;
+    }
+
+    // Packs a context for the internal stages. IDs are looked up, not
+    // interned: unknown names are dropped (see PackedDialogueContext).
+    // Unpack gives back the known part, with threat on the 1/255 grid.
+    PackedDialogueContext PackContext(const DialogueContext& ctx) const
+    {
+        PackedDialogueContext p;
+        std::vector<uint32_t> ids;
+        PackContextFields(ctx, p);
+        FindContextIds(ctx.activeTabooIds, ids);
+        p.tabooIds.Assign(ids);
+        FindContextIds(ctx.recentEventIds, ids);
+        p.eventIds.Assign(ids);
+        p.unnamedRumors = FindContextIds(ctx.knownRumorIds, ids);
+        p.rumorIds.Assign(ids);
+        return p;
+    }
+
+    // Names location, region, taboo, event or rumor IDs ahead of time so
+    // contexts carrying them can match and token resolvers see them.
+    // Names used by templates, region state and SeedRumor are known
+    // already.
+    void DeclareContextIds(const std::vector<std::string>& names)
+    {
+        for (const std::string& name : names)
+        {
+            if (name.empty())
+                continue;
+            if (recording)
+                RecordEntry(DialogueReplayEntry::Kind::DeclareContextId).id = name;
+            contextIds.Intern(name);
+        }
+    }
+
+    DialogueContext UnpackContext(const PackedDialogueContext& p) const
+    {
+        using Packed = PackedDialogueContext;
+        DialogueContext ctx;
+        ctx.regionTone = p.regionTone;
+        ctx.threatLevel01 = p.ThreatLevel01();
+        ctx.isIndoors = p.Has(Packed::Indoors);
+        ctx.isNight = p.Has(Packed::Night);
+        ctx.playerRecentlyBrokeTaboo = p.Has(Packed::PlayerRecentlyBrokeTaboo);
+        ctx.playerLowHealth = p.Has(Packed::PlayerLowHealth);
+        ctx.playerIsBleeding = p.Has(Packed::PlayerIsBleeding);
+        ctx.inSafeRoomFlagged = p.Has(Packed::InSafeRoom);
+        if (p.locationId != IdInterner::kInvalid)
+            ctx.locationId = contextIds.Name(p.locationId);
+        if (p.regionId != IdInterner::kInvalid)
+            ctx.regionId = contextIds.Name(p.regionId);
+        for (uint32_t id : p.tabooIds) ctx.activeTabooIds.insert(contextIds.Name(id));
+        for (uint32_t id : p.eventIds) ctx.recentEventIds.insert(contextIds.Name(id));
+        for (uint32_t id : p.rumorIds) ctx.knownRumorIds.insert(contextIds.Name(id));
+        // Placeholders keep KnownRumorCount; they stay unknown when repacked.
+        for (uint32_t i = 0; i < p.unnamedRumors; ++i)
+            ctx.knownRumorIds.insert("?unnamed_rumor_" + std::to_string(i));
+        return ctx;
+    }
+
+    // Deferred lines. Selection happens now (and advances cooldowns,
+    // recency and the NPC's trigger sequence exactly like GenerateLine);
+    // substitutions and style passes only run when the handle is realized.
+    // Contexts are captured once per tick with SnapshotContext and shared
+    // by every line deferred against them.
+    ContextSnapshotId SnapshotContext(const DialogueContext& ctx)
+    {
+        return SnapshotContext(PackContext(ctx));
+    }
+
+    ContextSnapshotId SnapshotContext(const PackedDialogueContext& ctx)
+    {
+        contextSnapshots.push_back(ctx);
+        return static_cast<ContextSnapshotId>(contextSnapshots.size() - 1);
+    }
+
+    // Drops all snapshots; handles that refer to them no longer realize.
+    // Snapshots still used by queued triggers are kept (renumbered).
+    void ReleaseContextSnapshots()
+    {
+        std::vector<PackedDialogueContext> kept;
+        if (queuedTriggerCount > 0)
+        {
+            std::vector<ContextSnapshotId> remap(contextSnapshots.size(), DeferredDialogueLine::kNone);
+            for (std::deque<QueuedTrigger>& bucket : triggerQueue)
+            {
+                for (QueuedTrigger& q : bucket)
+                {
+                    if (q.snapshot >= contextSnapshots.size())
+                        continue;
+                    if (remap[q.snapshot] == DeferredDialogueLine::kNone)
+                    {
+                        remap[q.snapshot] = static_cast<ContextSnapshotId>(kept.size());
+                        kept.push_back(std::move(contextSnapshots[q.snapshot]));
+                    }
+                    q.snapshot = remap[q.snapshot];
+                }
+            }
+        }
+        contextSnapshots.swap(kept);
+        ++snapshotEpoch;
+    }
+
+    DeferredDialogueLine GenerateLineDeferred(const std::string& npcId,
+                                              const std::string& triggerTag,
+                                              ContextSnapshotId snapshot,
+                                              const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLineDeferred(FindNPC(npcId), FindTrigger(triggerTag), snapshot, fallback);
+    }
+
+    DeferredDialogueLine GenerateLineDeferred(NPCHandle handle,
+                                              TriggerId trigger,
+                                              ContextSnapshotId snapshot,
+                                              const FallbackLadder& fallback = FallbackLadder())
+    {
+        NPCRecord* npc = ResolveNPC(handle);
+        if (!npc || trigger.index >= triggerTable.size() || snapshot >= contextSnapshots.size())
+            return DeferredDialogueLine();
+
+        const PackedDialogueContext& ctx = contextSnapshots[snapshot];
+        const uint64_t sequence = npc->triggerSequence++;
+        DeferredDialogueLine line;
+        line.rng = RNG(RNG::StreamKey(sessionSeed, npc->streamKey, sequence));
+        const DialogueTemplate* chosen = SelectLine(*npc, trigger, ctx, fallback, line.rng, line.function);
+        if (chosen)
+        {
+            line.templateIndex = IndexOf(*chosen);
+            line.templateEpoch = templateEpoch;
+            line.contextSnapshot = snapshot;
+            line.snapshotEpoch = snapshotEpoch;
+            line.speaker = npc->handle;
+            line.voiceVersion = voices[npc->voiceIndex].version;
+        }
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::DeferLine);
+            e.npcId = *npc->npcId;
+            e.triggerTag = triggerTable[trigger.index].tag;
+            e.triggerSequence = sequence;
+            e.ctx = UnpackContext(ctx);
+            e.fallback = fallback;
+            e.line = chosen ? chosen->id : std::string();
+        }
+        return line;
+    }
+
+    bool IsDeferredLineValid(const DeferredDialogueLine& line) const
+    {
+        const NPCRecord* speaker = ResolveNPC(line.speaker);
+        return line &&
+               line.templateEpoch == templateEpoch &&
+               line.templateIndex < templates.size() &&
+               line.snapshotEpoch == snapshotEpoch &&
+               line.contextSnapshot < contextSnapshots.size() &&
+               speaker && voices[speaker->voiceIndex].version == line.voiceVersion;
+    }
+
+    DialogueLineResult RealizeDeferred(const DeferredDialogueLine& line,
+                                       char* buffer,
+                                       std::size_t capacity)
+    {
+        if (!IsDeferredLineValid(line))
+            return DialogueLineResult();
+
+        LineBuffer out(buffer, capacity);
+        return RealizeLine(templates[line.templateIndex], line.function,
+                           contextSnapshots[line.contextSnapshot], *npcs[line.speaker.index].voice, line.rng, out);
+    }
+
+    // Realizes `count` handles back to back into one buffer; results[i]
+    // views its slice of `buffer`. Stale lines come back empty; once the
+    // buffer runs short, lines come back truncated (possibly to nothing)
+    // with `truncated` set. Returns the number of non-empty lines.
+    std::size_t RealizeDeferredBatch(const DeferredDialogueLine* lines,
+                                     std::size_t count,
+                                     char* buffer,
+                                     std::size_t capacity,
+                                     DialogueLineResult* results)
+    {
+        std::size_t used = 0;
+        std::size_t written = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            results[i] = RealizeDeferred(lines[i], buffer + used, capacity - used);
+            used += results[i].text.size();
+            if (results[i])
+                ++written;
+        }
+        return written;
+    }
+
+    // Trigger queue. Triggers collected during a frame are deduped per
+    // (NPC, trigger) and flushed in function priority order (level 0
+    // first, FIFO within a level); whatever the time budget leaves is
+    // carried over to the next flush. The priority is taken from the
+    // trigger's mapped function when it is enqueued.
+    bool EnqueueTrigger(NPCHandle handle,
+                        TriggerId trigger,
+                        ContextSnapshotId snapshot,
+                        const FallbackLadder& fallback = FallbackLadder())
+    {
+        const NPCRecord* npc = ResolveNPC(handle);
+        if (!npc || trigger.index >= triggerTable.size() || snapshot >= contextSnapshots.size())
+            return false;
+
+        auto inserted = queuedTriggerKeys.emplace(QueuedTriggerKey(handle, trigger), handle.generation);
+        if (!inserted.second)
+        {
+            if (inserted.first->second == handle.generation)
+                return false;   // already queued
+            inserted.first->second = handle.generation;   // key left by a dead NPC
+        }
+
+        const DialogueFunction fn = MapTriggerToFunction(trigger, contextSnapshots[snapshot], *npc);
+        triggerQueue[functionPriority[static_cast<std::size_t>(fn)]].push_back(
+            QueuedTrigger{ handle, trigger, snapshot, fallback });
+        ++queuedTriggerCount;
+        return true;
+    }
+
+    // String-ID form; take one SnapshotContext per frame and share it.
+    bool EnqueueTrigger(const std::string& npcId,
+                        const std::string& triggerTag,
+                        ContextSnapshotId snapshot,
+                        const FallbackLadder& fallback = FallbackLadder())
+    {
+        return EnqueueTrigger(FindNPC(npcId), FindTrigger(triggerTag), snapshot, fallback);
+    }
+
+    // Generates queued lines into `buffer` until `budgetMicroseconds` is
+    // spent or fewer than kQueuedLineReserve bytes are left; at least one
+    // trigger is processed per call. `out` is cleared and receives one
+    // entry per processed trigger whose NPC is still alive. Returns the
+    // number of triggers taken off the queue.
+    static constexpr std::size_t kQueuedLineReserve = 256;
+
+    std::size_t FlushTriggerQueue(uint32_t budgetMicroseconds,
+                                  char* buffer,
+                                  std::size_t capacity,
+                                  std::vector<QueuedDialogueLine>& out)
+    {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now() + std::chrono::microseconds(budgetMicroseconds);
+
+        out.clear();
+        std::size_t processed = 0;
+        std::size_t used = 0;
+        for (std::deque<QueuedTrigger>& bucket : triggerQueue)
+        {
+            while (!bucket.empty())
+            {
+                if (processed > 0 && (capacity - used < kQueuedLineReserve || Clock::now() >= deadline))
+                    return processed;
+
+                const QueuedTrigger q = bucket.front();
+                bucket.pop_front();
+                --queuedTriggerCount;
+                ++processed;
+
+                auto key = queuedTriggerKeys.find(QueuedTriggerKey(q.npc, q.trigger));
+                if (key != queuedTriggerKeys.end() && key->second == q.npc.generation)
+                    queuedTriggerKeys.erase(key);
+
+                if (!ResolveNPC(q.npc) || q.snapshot >= contextSnapshots.size())
+                    continue;
+
+                QueuedDialogueLine line;
+                line.npc = q.npc;
+                line.trigger = q.trigger;
+                line.result = GenerateLine(q.npc, q.trigger, contextSnapshots[q.snapshot],
+                                           buffer + used, capacity - used, q.fallback);
+                used += line.result.text.size();
+                out.push_back(line);
+            }
+        }
+        return processed;
+    }
+
+    std::size_t GetQueuedTriggerCount() const
+    {
+        return queuedTriggerCount;
+    }
+
+    // Flush order of a function's triggers; 0 is flushed first. Defaults:
+    // Pain/ThreatBark, then Surprise, Dread/RitualHint, the other
+    // informational functions, and NeutralAmbient last.
+    void SetFunctionPriority(DialogueFunction fn, uint8_t level)
+    {
+        functionPriority[static_cast<std::size_t>(fn)] =
+            std::min<uint8_t>(level, static_cast<uint8_t>(kDialogueFunctionCount - 1));
+    }
+
+    // Candidate sets for every tier of a ladder, in one walk over the
+    // NPC's eligible templates. outTiers[i] matches ladder.tiers[i].
+    bool CollectCandidateTiers(const std::string& npcId,
+                               const DialogueContext& ctx,
+                               const FallbackLadder& ladder,
+                               std::vector<std::vector<const DialogueTemplate*>>& outTiers) const
+    {
+        const NPCRecord* npc = FindNPCRecord(npcId);
+        if (!npc) return false;
+
+        const PackedDialogueContext packed = PackContext(ctx);
+        outTiers.resize(ladder.count);
+        for (std::size_t i = 0; i < ladder.count; ++i)
+            CollectCandidates(packed, *npc, ladder.tiers[i], outTiers[i]);
+        return true;
+    }
+
+    // Region-tracked context. Contexts naming a tracked regionId read their
+    // taboo/event eligibility from these live sets; toggling an ID only
+    // touches the templates that reference it. An empty regionId never
+    // names a tracked region, so these calls ignore it.
+    void SetTabooActive(const std::string& regionId,
+                        const std::string& tabooId,
+                        bool active)
+    {
+        if (regionId.empty())
+            return;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetTabooActive);
+            e.regionId = regionId;
+            e.id = tabooId;
+            e.active = active;
+        }
+
+        RegionLiveState& region = AcquireRegion(regionId);
+        const uint32_t id = contextIds.Intern(tabooId);
+        if (ToggleRegionId(region, region.activeTabooIds, tabooDependents, id, active))
+            EditRegionContext(region, [&](PackedDialogueContext& ctx) { ctx.tabooIds.Set(id, active); });
+    }
+
+    void SetEventActive(const std::string& regionId,
+                        const std::string& eventId,
+                        bool active)
+    {
+        if (regionId.empty())
+            return;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SetEventActive);
+            e.regionId = regionId;
+            e.id = eventId;
+            e.active = active;
+        }
+
+        // Either way the game now owns the event; NotifyEvent's expiry no
+        // longer applies.
+        RegionLiveState& region = AcquireRegion(regionId);
+        const uint32_t id = contextIds.Intern(eventId);
+        region.notifiedEventExpiry.erase(id);
+        SetRegionEventActive(region, id, active);
+    }
+
+    // Region context service. Each tracked region keeps one shared
+    // snapshot; SetTabooActive / SetEventActive / NotifyEvent and
+    // SetRegionAmbient update it in place, or copy it first while a
+    // caller still holds the previous version. Fetch it once per frame
+    // and pass a per-NPC overlay to GenerateLine instead of building a
+    // DialogueContext per NPC.
+    void SetRegionAmbient(const std::string& regionId, const RegionAmbient& ambient)
+    {
+        using Packed = PackedDialogueContext;
+        const uint32_t locationId = ambient.locationId.empty() ? IdInterner::kInvalid
+                                                               : contextIds.Intern(ambient.locationId);
+        EditRegionContext(AcquireRegion(regionId), [&](Packed& ctx)
+        {
+            ctx.regionTone = ambient.regionTone;
+            ctx.threat = Packed::QuantizeThreat(ambient.threatLevel01);
+            ctx.Set(Packed::Night, ambient.isNight);
+            ctx.Set(Packed::Indoors, ambient.isIndoors);
+            ctx.locationId = locationId;
+        });
+    }
+
+    std::shared_ptr<const RegionContextSnapshot> GetRegionContext(const std::string& regionId)
+    {
+        return AcquireRegion(regionId).context;
+    }
+
+    // The region's context with string IDs, unpacked on each call.
+    void GetRegionContext(const std::string& regionId, DialogueContext& out)
+    {
+        out = UnpackContext(AcquireRegion(regionId).context->packed);
+    }
+
+    std::string GenerateLine(NPCHandle npc,
+                             TriggerId trigger,
+                             const RegionContextSnapshot& region,
+                             const DialogueContextOverlay& overlay,
+                             const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npc, trigger, ResolveOverlay(region, overlay), fallback);
+    }
+
+    DialogueLineResult GenerateLine(NPCHandle npc,
+                                    TriggerId trigger,
+                                    const RegionContextSnapshot& region,
+                                    const DialogueContextOverlay& overlay,
+                                    char* buffer,
+                                    std::size_t capacity,
+                                    const FallbackLadder& fallback = FallbackLadder())
+    {
+        return GenerateLine(npc, trigger, ResolveOverlay(region, overlay), buffer, capacity, fallback);
+    }
+
+    // Records an emergent event in the region's event ring. Until it
+    // decays below EmergentEventPolicy::rumorSeverity01 or leaves the
+    // retention window, NPCs speaking in that region treat it as a known
+    // rumor (TriggerRule::Input::KnownRumorCount) and it is active in the
+    // region, unless SetEventActive has taken the event over. Events
+    // without a regionId are not tracked.
+    void NotifyEvent(const std::string& eventId,
+                     const std::string& regionId,
+                     float severity01)
+    {
+        if (regionId.empty())
+            return;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::NotifyEvent);
+            e.regionId = regionId;
+            e.id = eventId;
+            e.value = severity01;
+        }
+
+        RegionLiveState& region = AcquireRegion(regionId);
+        EventRing::Entry e;
+        e.timestampSeconds = currentTimeSeconds;
+        e.severity01 = severity01;
+        e.decayScore = DecayScore(severity01, currentTimeSeconds);
+        e.eventId = contextIds.Intern(eventId);
+        region.events.Push(e);
+        NoteFreshRumor(region, e);
+
+        auto notified = region.notifiedEventExpiry.find(e.eventId);
+        if (notified == region.notifiedEventExpiry.end() && region.activeEventIds.count(e.eventId))
+            return;   // set active by the game
+        const double expires = FreshUntilSeconds(e);
+        if (notified != region.notifiedEventExpiry.end())
+        {
+            if (expires <= notified->second)
+                return;
+            notified->second = expires;
+        }
+        else
+        {
+            if (expires <= currentTimeSeconds)
+                return;
+            region.notifiedEventExpiry.emplace(e.eventId, expires);
+            SetRegionEventActive(region, e.eventId, true);
+        }
+        eventExpiryWheel.Schedule(EventExpiryPayload(region, e.eventId), expires);
+    }
+
+    // Capacity changes keep each region's newest events.
+    void SetEmergentEventPolicy(const EmergentEventPolicy& policy)
+    {
+        const bool resize = policy.perRegionCapacity != eventPolicy.perRegionCapacity;
+        const bool rescore = policy.severityHalfLifeSeconds != eventPolicy.severityHalfLifeSeconds;
+        eventPolicy = policy;
+        for (auto& entry : regions)
+        {
+            EventRing& ring = entry.second.events;
+            if (resize)
+                ring.SetCapacity(eventPolicy.perRegionCapacity);
+            for (std::size_t i = 0; rescore && i < ring.Size(); ++i)
+                ring.At(i).decayScore = DecayScore(ring.At(i).severity01, ring.At(i).timestampSeconds);
+            entry.second.freshRumors.clear();
+            for (std::size_t i = 0; i < ring.Size(); ++i)
+                NoteFreshRumor(entry.second, ring.At(i));
+
+            // Re-time notified events from their newest ring entries; one
+            // no longer in the ring expires on the next tick.
+            for (auto& notified : entry.second.notifiedEventExpiry)
+            {
+                double expires = currentTimeSeconds;
+                for (std::size_t i = 0; i < ring.Size(); ++i)
+                {
+                    if (ring.At(i).eventId == notified.first)
+                        expires = std::max(expires, FreshUntilSeconds(ring.At(i)));
+                }
+                notified.second = expires;
+                eventExpiryWheel.Schedule(EventExpiryPayload(entry.second, notified.first), expires);
+            }
+        }
+    }
+
+    // Appends the region's events notified at or after `sinceSeconds`
+    // (and within the retention window) whose decayed severity is at
+    // least `minSeverity01`, oldest first. The window is located by binary
+    // search; each event inside it costs one compare. Returns the count.
+    std::size_t QueryRegionEvents(const std::string& regionId,
+                                  double sinceSeconds,
+                                  float minSeverity01,
+                                  std::vector<EmergentEventView>& out) const
+    {
+        const RegionLiveState* region = FindRegion(regionId);
+        if (!region)
+            return 0;
+
+        const EventRing& ring = region->events;
+        const double cutoff = DecayCutoff(minSeverity01);
+        std::size_t found = 0;
+        for (std::size_t i = FirstRetainedEvent(ring, sinceSeconds); i < ring.Size(); ++i)
+        {
+            const EventRing::Entry& e = ring.At(i);
+            if (e.decayScore < cutoff)
+                continue;
+            out.push_back(EmergentEventView{ contextIds.Name(e.eventId),
+                                             DecayedSeverity(e), e.timestampSeconds });
+            ++found;
+        }
+        return found;
+    }
+
+    // Rumor diffusion. Rumors spread one hop per StepRumors along the
+    // social graph; NPCs inherit ties through their slot, so rebuild the
+    // graph after spawning. An unregistered NPC's ties stay cut until the
+    // next SetSocialGraph. Rumors an NPC knows count towards the
+    // KnownRumorCount trigger input.
+    void SetSocialGraph(const std::vector<SocialEdge>& edges)
+    {
+        std::vector<RumorDiffusion::Edge> live;
+        live.reserve(edges.size());
+        for (const SocialEdge& e : edges)
+        {
+            if (ResolveNPC(e.speaker) && ResolveNPC(e.listener) && e.speaker != e.listener)
+                live.push_back(RumorDiffusion::Edge{ e.speaker.index, e.listener.index, e.talkChance01 });
+        }
+
+        if (recording)
+        {
+            DialogueReplayEntry& r = RecordEntry(DialogueReplayEntry::Kind::SetSocialGraph);
+            r.ties.reserve(live.size());
+            for (const RumorDiffusion::Edge& e : live)
+                r.ties.push_back({ *npcs[e.speaker].npcId, *npcs[e.listener].npcId, e.talkChance01 });
+        }
+
+        rumorDiffusion.SetGraph(npcs.size(), live);
+    }
+
+    void SetRumorDiffusionPolicy(const RumorDiffusionPolicy& policy)
+    {
+        if (recording)
+            RecordEntry(DialogueReplayEntry::Kind::SetRumorDiffusionPolicy).rumorPolicy = policy;
+        rumorPolicy = policy;
+        for (const NPCRecord& npc : npcs)
+            RefreshDistortThreshold(npc);
+    }
+
+    // Gives `npc` first-hand (or, with `distorted`, garbled) knowledge.
+    bool SeedRumor(NPCHandle handle, const std::string& rumorId, bool distorted = false)
+    {
+        const NPCRecord* npc = ResolveNPC(handle);
+        if (!npc)
+            return false;
+
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::SeedRumor);
+            e.npcId = *npc->npcId;
+            e.id = rumorId;
+            e.active = distorted;
+        }
+
+        const uint32_t rumor = rumorIds.Intern(rumorId);
+        const uint32_t contextId = contextIds.Intern(rumorId);
+        if (contextId >= rumorByContextId.size())
+            rumorByContextId.resize(contextId + 1, kNoRumor);
+        rumorByContextId[contextId] = rumor;
+        rumorDiffusion.Reserve(npcs.size(), rumorIds.Size());
+        rumorDiffusion.Learn(handle.index, rumor, distorted);
+        return true;
+    }
+
+    // NotifyEvent, with the event seeded as a rumor into its witnesses.
+    void NotifyEvent(const std::string& eventId,
+                     const std::string& regionId,
+                     float severity01,
+                     const std::vector<NPCHandle>& witnesses)
+    {
+        NotifyEvent(eventId, regionId, severity01);
+        for (NPCHandle witness : witnesses)
+            SeedRumor(witness, eventId);
+    }
+
+    void StepRumors()
+    {
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::StepRumors);
+            e.triggerSequence = rumorStep;
+        }
+
+        rumorDiffusion.Reserve(npcs.size(), rumorIds.Size());
+
+        std::size_t threads = rumorPolicy.workerThreads;
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        rumorDiffusion.Step(RNG::StreamKey(sessionSeed, StableHash64("rumor"), rumorStep++),
+                            rumorDistortThresholds, threads);
+    }
+
+    bool NPCKnowsRumor(NPCHandle handle, const std::string& rumorId, bool* outDistorted = nullptr) const
+    {
+        const uint32_t rumor = rumorIds.Find(rumorId);
+        return ResolveNPC(handle) && rumor != IdInterner::kInvalid &&
+               rumorDiffusion.Knows(handle.index, rumor, outDistorted);
+    }
+
+    std::size_t GetKnownRumorCount(NPCHandle handle) const
+    {
+        return ResolveNPC(handle) ? rumorDiffusion.KnownCount(handle.index) : 0;
+    }
+
+    // Appends the IDs of every rumor the NPC knows, in interning order.
+    std::size_t CollectKnownRumors(NPCHandle handle, std::vector<std::string_view>& out) const
+    {
+        if (!ResolveNPC(handle))
+            return 0;
+        const std::size_t before = out.size();
+        rumorDiffusion.ForEachKnown(handle.index, [&](uint32_t rumor) { out.push_back(rumorIds.Name(rumor)); });
+        return out.size() - before;
+    }
+
+private:
+    // Template indices that pass every profile-static filter (role, region
+    // tone), bucketed by function and by the context's region tone. Shared
+    // by all NPCs with the same static key.
+    // A bucket whose templates have no context-dependent predicate is
+    // "static": its candidates never change between calls, so it is
+    // sampled through an alias table rebuilt lazily after edits.
+    //
+    // Static buckets whose global weight scales changed since the alias
+    // build switch to a Fenwick tree (`modulated`) so further updates stay
+    // O(log n).
+    struct EligibilityBucket
+    {
+        std::vector<uint32_t> indices;
+        bool                  isStatic = true;
+        bool                  dirty = true;
+        AliasTable            alias;
+
+        bool                  modulated = false;
+        FenwickTree           weighted;
+        uint32_t              weightVersion = 0;  // bumped on any weight change
+        std::unordered_map<uint32_t, uint32_t> slotOf; // template index -> slot
+    };
+
+    static constexpr uint32_t kStaleWeights = 0xFFFFFFFFu;
+    static constexpr int      kMaxRecencyRejections = 4;
+
+    // Per-NPC weights of one static bucket, built only for NPCs that have
+    // per-NPC scales there.
+    struct NPCBucketWeights
+    {
+        FenwickTree tree;
+        uint32_t    version = kStaleWeights;
+    };
+
+    // Per-NPC template weights; allocated by the first
+    // SetNPCTemplateWeightScale for the NPC.
+    struct NPCWeightOverrides
+    {
+        std::unordered_map<uint32_t, float> scales; // template index -> scale
+        std::unordered_map<const EligibilityBucket*, NPCBucketWeights> buckets;
+    };
+
+    static constexpr uint32_t kNoRecencyWindow = 0xFFFFFFFFu;
+
+    struct StaticEligibility
+    {
+        SpeakerSocialRole role = SpeakerSocialRole::Villager;
+        std::array<std::array<EligibilityBucket, kRegionToneCount>, kDialogueFunctionCount> buckets;
+
+        EligibilityBucket& Bucket(DialogueFunction fn, RegionTone tone)
+        {
+            return buckets[static_cast<std::size_t>(fn)][static_cast<std::size_t>(tone)];
+        }
+        const EligibilityBucket& Bucket(DialogueFunction fn, RegionTone tone) const
+        {
+            return buckets[static_cast<std::size_t>(fn)][static_cast<std::size_t>(tone)];
+        }
+
+        bool Owns(const EligibilityBucket* bucket) const
+        {
+            for (const auto& row : buckets)
+            {
+                for (const auto& b : row)
+                {
+                    if (&b == bucket)
+                        return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // Voice storage. Archetypes and their override variants are shared by
+    // many NPCs; Private voices belong to one RegisterNPCProfile NPC.
+    enum class VoiceKind : uint8_t
+    {
+        Archetype,
+        Variant,
+        Private
+    };
+
+    struct VoiceRecord
+    {
+        std::unique_ptr<NPCVoiceProfile> profile;   // stable address
+        VoiceKind         kind = VoiceKind::Private;
+        uint32_t          base = 0;                 // archetype of a Variant; else itself
+        NPCVoiceOverrides overrides;                // Variant only
+        uint32_t          users = 0;                // NPCs bound to this voice
+        uint64_t          version = 0;              // new value whenever the profile is written
+    };
+
+    // Trigger dispatch table: each trigger owns a contiguous run of
+    // compiled rules in triggerRules. The summary fields cover the rules
+    // that can run (up to the first one that always passes).
+    struct TriggerEntry
+    {
+        std::string tag;
+        uint32_t    firstRule = 0;
+        uint32_t    ruleCount = 0;
+        uint16_t    functions = 0;            // bit per DialogueFunction a rule picks
+        bool        exhaustive = false;       // some rule always passes
+        bool        readsRumorCount = false;  // some rule reads KnownRumorCount
+    };
+
+    struct CompiledTriggerRule
+    {
+        float            threshold = 0.0f;
+        uint8_t          input = 0;
+        bool             inclusive = false;   // also pass on equality
+        bool             negate = false;
+        DialogueFunction function = DialogueFunction::NeutralAmbient;
+    };
+
+    // Cooldown timers are not kept here; see npcReadyAtSeconds.
+    struct NPCRecord
+    {
+        NPCHandle              handle;
+        bool                   alive = false;
+        const std::string*     npcId = nullptr;     // key in npcHandleById
+        double                 lastActiveSeconds = 0.0;
+        const NPCVoiceProfile* voice = nullptr;     // voices[voiceIndex]
+        uint32_t               voiceIndex = 0;
+        StaticEligibility* eligibility = nullptr;
+        std::unique_ptr<NPCWeightOverrides> weights;  // null unless scaled per NPC
+        uint32_t recentSlot = kNoRecencyWindow;       // npcRecent index, from the first pick
+        uint64_t streamKey = 0;        // stable hash of npcId
+        uint64_t triggerSequence = 0;  // GenerateLine calls so far
+        ThrottleGroupId squadGroup = kNoThrottleGroup;
+        ThrottleGroupId regionGroup = kNoThrottleGroup;
+    };
+
+    // Template text split at load time: either a literal span of
+    // DialogueTemplate::text or a token, stored as an index into the
+    // template's own tokenSlots.
+    struct TextSegment
+    {
+        static constexpr uint8_t kLiteral = 0xFF;
+
+        uint32_t begin = 0;
+        uint32_t length = 0;
+        uint8_t  token = kLiteral;
+    };
+
+    // Distinct tokens per template; extra ones stay literal.
+    static constexpr std::size_t kMaxTemplateTokens = 16;
+
+    struct TokenResolverEntry
+    {
+        std::string   name;
+        TokenResolver resolver = nullptr;
+        void*         userData = nullptr;
+    };
+
+    // Interned taboo/event/location requirements of one template, kept
+    // parallel to `templates`.
+    struct CompiledTemplate
+    {
+        std::vector<uint32_t> tabooIds;          // sorted, unique
+        std::vector<uint32_t> eventIds;          // sorted, unique
+        std::vector<uint32_t> blockedLocationIds;
+        uint8_t               roleMask = 0xFF;   // bit per SpeakerSocialRole
+        bool                  contextFree = true; // no taboo/event/location/condition
+        std::vector<TextSegment> segments;       // pre-tokenized text
+        std::vector<uint16_t>    tokenSlots;     // resolver slot per distinct token
+    };
+
+    // An event's ring entry that stays fresh the longest.
+    struct FreshRumor
+    {
+        uint32_t eventId = 0;
+        double   freshUntilSeconds = 0.0;
+        double   timestampSeconds = 0.0;
+        double   decayScore = 0.0;
+    };
+
+    // Live candidate state of one tracked region. A template is live when
+    // every taboo/event it requires is active in the region.
+
+    struct RegionLiveState
+    {
+        static constexpr uint32_t kNotLive = 0xFFFFFFFFu;
+
+        std::unordered_set<uint32_t> activeTabooIds;
+        std::unordered_set<uint32_t> activeEventIds;
+        std::unordered_map<uint32_t, double> notifiedEventExpiry;   // activated by NotifyEvent, until
+        std::vector<FreshRumor> freshRumors;      // events counting as rumors, by ID
+        EventRing events;                         // emergent events, oldest first
+        std::shared_ptr<RegionContextSnapshot> context;
+        std::vector<uint16_t> missing;            // per template: unmet requirements
+        std::vector<uint32_t> livePos;            // per template: slot in live[fn]
+        std::array<std::vector<uint32_t>, kDialogueFunctionCount> live;
+    };
+
+    uint64_t sessionSeed = 0;
+    bool recording = false;
+    DialogueSessionLog sessionLog;
+    double currentTimeSeconds = 0.0;
+    SamplingMode samplingMode = SamplingMode::Streaming;
+    RecencyPolicy recencyPolicy;
+    RecencyWindow<64> globalRecent;
+    std::vector<RecencyWindow<8>> npcRecent;     // by NPCRecord::recentSlot
+    std::vector<uint32_t> freeRecencySlots;
+
+    std::vector<NPCRecord> npcs;                          // by NPCHandle::index
+    std::vector<uint32_t> freeNPCSlots;
+
+    std::vector<TriggerEntry> triggerTable;              // by TriggerId::index
+    std::vector<CompiledTriggerRule> triggerRules;
+    std::size_t deadTriggerRules = 0;                     // replaced, awaiting compaction
+    std::unordered_map<std::string, TriggerId> triggerIdByTag;
+    std::vector<VoiceRecord> voices;
+    std::vector<uint32_t> freeVoiceSlots;
+    uint64_t voiceVersion = 0;                  // last VoiceRecord::version handed out
+    std::unordered_map<std::string, uint32_t> archetypeIndexById;
+    std::unordered_map<std::string, uint32_t> voiceVariantByKey;
+    std::unordered_map<std::string, NPCHandle> npcHandleById;
+
+    // Flat [npc][DialogueFunction] cooldown state. readyAt is the time the
+    // function may fire again, so the cooldown check is a single load.
+    std::vector<double> npcReadyAtSeconds;
+    std::vector<float>  npcCooldownSeconds;
+
+    // Cooldown expiry events: timers keyed by (npc << 8 | function), and
+    // per-function ready lists with each NPC's position in them.
+    static constexpr uint32_t kNotReady = 0xFFFFFFFFu;
+    static constexpr uint32_t kTimerGenerationMask = 0xFFFFFF;   // cooldown payload bits
+    TimingWheel cooldownWheel;
+    std::vector<CooldownExpiry> cooldownExpiries;
+    std::array<std::vector<NPCHandle>, kDialogueFunctionCount> readyNPCs;
+    std::vector<uint32_t> readyPos;   // flat [npc][function]
+
+    // Flat [group][DialogueFunction] token buckets; group 0 is global.
+    struct ThrottleBucket
+    {
+        BarkThrottle limit;
+        float        tokens = 0.0f;
+        double       lastRefillSeconds = 0.0;
+    };
+
+    static constexpr ThrottleGroupId kGlobalThrottleGroup = 0;
+    std::vector<ThrottleBucket> throttleBuckets = std::vector<ThrottleBucket>(kDialogueFunctionCount);
+    std::vector<DialogueTemplate> templates;
+    std::unordered_map<std::string, uint32_t> templateIndexById;
+    std::vector<CompiledTemplate> compiledTemplates;
+    std::vector<float> weightScales;   // global runtime scale per template
+    uint32_t templateEpoch = 0;        // bumped when template indices change
+
+    std::vector<PackedDialogueContext> contextSnapshots;
+    uint32_t snapshotEpoch = 0;
+
+    // Pending triggers, one FIFO per priority level. queuedTriggerKeys
+    // maps (npc index, trigger) to the generation of the queued NPC.
+    struct QueuedTrigger
+    {
+        NPCHandle         npc;
+        TriggerId         trigger;
+        ContextSnapshotId snapshot = 0;
+        FallbackLadder    fallback;
+    };
+
+    static uint64_t QueuedTriggerKey(NPCHandle npc, TriggerId trigger)
+    {
+        return (static_cast<uint64_t>(npc.index) << 32) | trigger.index;
+    }
+
+    std::array<std::deque<QueuedTrigger>, kDialogueFunctionCount> triggerQueue;
+    std::unordered_map<uint64_t, uint32_t> queuedTriggerKeys;
+    std::size_t queuedTriggerCount = 0;
+    std::array<uint8_t, kDialogueFunctionCount> functionPriority = {
+        4,  // NeutralAmbient
+        2,  // Dread
+        3,  // Misdirection
+        2,  // RitualHint
+        3,  // Rumor
+        3,  // Bureaucratic
+        0,  // ThreatBark
+        0,  // Pain
+        1   // Surprise
+    };
+
+    // Flat resolver table; templates refer to slots resolved at load time.
+    std::vector<TokenResolverEntry> tokenResolvers;
+    std::unordered_map<uint64_t, uint16_t> resolverSlotById;
+
+    std::vector<StylePass> stylePasses;
+    std::vector<std::unique_ptr<StaticEligibility>> eligibilitySets;
+
+    // Reverse index: interned taboo/event ID -> templates requiring it.
+    // Location blacklists stay on the template as sorted interned IDs.
+    IdInterner contextIds;
+    std::vector<std::vector<uint32_t>> tabooDependents;
+    std::vector<std::vector<uint32_t>> eventDependents;
+    std::unordered_map<std::string, RegionLiveState> regions;
+    std::vector<RegionLiveState*> regionByContextId;   // by interned region ID
+    EmergentEventPolicy eventPolicy;
+    TimingWheel eventExpiryWheel;                      // (region << 32 | event) -> fresh-until time
+
+    uint64_t regionContextVersion = 0;
+    struct PackScratch
+    {
+        PackedDialogueContext packed;
+        std::vector<uint32_t> taboos;
+        std::vector<uint32_t> events;
+        std::vector<uint32_t> rumors;
+    };
+    PackScratch packScratch;     // PackContextScratch; long lists view the vectors
+
+    // Rumor knowledge by NPC slot; rumor indices from rumorIds.
+    RumorDiffusion rumorDiffusion;
+    IdInterner rumorIds;
+    static constexpr uint32_t kNoRumor = 0xFFFFFFFFu;
+    std::vector<uint32_t> rumorByContextId;         // contextIds ID -> rumor index
+    RumorDiffusionPolicy rumorPolicy;
+    uint64_t rumorStep = 0;
+    std::vector<uint32_t> rumorDistortThresholds;   // per NPC slot; see RefreshDistortThreshold
+
+    SweepPolicy sweepPolicy;
+    std::size_t sweepNPCCursor = 0;
+    std::size_t sweepVoiceCursor = 0;
+
+private:
+    // --------------------------------------------------
+    // Template loading / initialization
+    // --------------------------------------------------
+    void InitializeDefaultTemplates()
+    {
+        // In production you would load these from Loreway YAML/JSON,
+        // already tagged with KG IDs and reliability flags.[file:1]
+
+        // Example: short dread line, forest village, generic villager.
+        DialogueTemplate t1;
+        t1.id = "ONB_FOREST_DREAD_01";
+        t1.function = DialogueFunction::Dread;
+        t1.reliability = ReliabilityTag::Unknown;
+        t1.regionTone = RegionTone::ForestVillage;
+        t1.allowedRoles = { SpeakerSocialRole::Villager, SpeakerSocialRole::Hermit };
+        t1.text = "The trees remember what the village forgets.";
+        t1.weight = 2.0f;
+        t1.condition = [](const DialogueConditionContext& c)
+        {
+            return c.ctx.Has(PackedDialogueContext::Night) && c.ctx.ThreatAbove(0.3f);
+        };
+        AddTemplate(t1);
+
+        // Example: explicit lie about disappearances, flagged KnownFalse
+        DialogueTemplate t2;
+        t2.id = "ONB_VILLAGER_LIE_DISAPPEAR";
+        t2.function = DialogueFunction::Misdirection;
+        t2.reliability = ReliabilityTag::KnownFalse;
+        t2.regionTone = RegionTone::ForestVillage;
+        t2.allowedRoles = { SpeakerSocialRole::Villager };
+        t2.requiredEventIds = { "EV_WELL_COLLAPSE_ASHDITCH" };
+        t2.text = "No one has gone missing since they fixed the wires.";
+        t2.weight = 1.0f;
+        t2.condition = [](const DialogueConditionContext& c)
+        {
+            return c.ctx.Has(PackedDialogueContext::Night); // later, KG can confirm this conflicts with posters
+        };
+        AddTemplate(t2);
+
+        // Example: ritual hint line tied to a taboo
+        DialogueTemplate t3;
+        t3.id = "ONB_RITUAL_HINT_WHISTLE";
+        t3.function = DialogueFunction::RitualHint;
+        t3.reliability = ReliabilityTag::Partial;
+        t3.regionTone = RegionTone::ForestVillage;
+        t3.allowedRoles = { SpeakerSocialRole::Villager, SpeakerSocialRole::Priest };
+        t3.requiredTabooIds = { "TABS_WHISTLE_AT_NIGHT" };
+        t3.text = "If the branches start singing, count your teeth and keep walking.";
+        t3.weight = 1.5f;
+        t3.condition = [](const DialogueConditionContext& c)
+        {
+            return c.ctx.Has(PackedDialogueContext::Night) && c.ctx.ThreatAbove(0.2f);
+        };
+        AddTemplate(t3);
+
+        // Example: bureaucratic tone, block apartment
+        DialogueTemplate t4;
+        t4.id = "BUREAU_FLAT_NOTICE_01";
+        t4.function = DialogueFunction::Bureaucratic;
+        t4.reliability = ReliabilityTag::Truthful;
+        t4.regionTone = RegionTone::SovietApartment;
+        t4.allowedRoles = { SpeakerSocialRole::Bureaucrat, SpeakerSocialRole::Doctor };
+        t4.text = "If you hear singing in the stairwell, do not open your door. The building committee is handling it.";
+        t4.weight = 1.0f;
+        t4.condition = [](const DialogueConditionContext& c)
+        {
+            return c.ctx.Has(PackedDialogueContext::Indoors) && c.ctx.Has(PackedDialogueContext::Night);
+        };
+        AddTemplate(t4);
+
+        // Example: pain bark with small body substitution
+        DialogueTemplate t5;
+        t5.id = "GENERIC_PAIN_01";
+        t5.function = DialogueFunction::Pain;
+        t5.reliability = ReliabilityTag::Truthful;
+        t5.text = "Hold still. You're leaking like the old well.";
+        t5.weight = 3.0f;
+        t5.condition = [](const DialogueConditionContext& c)
+        {
+            return c.ctx.Has(PackedDialogueContext::PlayerIsBleeding);
+        };
+        AddTemplate(t5);
+
+        // You can keep adding templates or load them from external data here.
+    }
+
+    // --------------------------------------------------
+    // Static eligibility (profile-static filters)
+    // --------------------------------------------------
+    uint32_t AddVoice(VoiceKind kind, const NPCVoiceProfile& profile)
+    {
+        uint32_t index;
+        if (!freeVoiceSlots.empty())
+        {
+            index = freeVoiceSlots.back();
+            freeVoiceSlots.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(voices.size());
+            voices.emplace_back();
+        }
+
+        VoiceRecord& v = voices[index];
+        v.profile = std::make_unique<NPCVoiceProfile>(profile);
+        v.kind = kind;
+        v.base = index;
+        v.overrides = NPCVoiceOverrides();
+        v.users = 0;
+        v.version = ++voiceVersion;
+        return index;
+    }
+
+    // Private voices die with their NPC; unused variants are left for the
+    // sweeper so spawn/despawn churn doesn't rebuild them every time.
+    void ReleaseVoice(uint32_t index)
+    {
+        VoiceRecord& v = voices[index];
+        if (--v.users == 0 && v.kind == VoiceKind::Private)
+            FreeVoice(index);
+    }
+
+    void FreeVoice(uint32_t index)
+    {
+        VoiceRecord& v = voices[index];
+        if (v.kind == VoiceKind::Variant)
+            voiceVariantByKey.erase(VariantKey(v.base, v.overrides));
+        v.profile.reset();
+        v.kind = VoiceKind::Private;
+        freeVoiceSlots.push_back(index);
+    }
+
+    // Archetype, override mask/role and the overridden values.
+    static std::string VariantKey(uint32_t archetype, const NPCVoiceOverrides& overrides)
+    {
+        char key[sizeof(uint32_t) + 3 + sizeof(float) * NPCVoiceOverrides::kSliderCount];
+        std::size_t n = 0;
+        std::memcpy(key, &archetype, sizeof(archetype));
+        n += sizeof(archetype);
+        key[n++] = static_cast<char>(overrides.mask);
+        key[n++] = static_cast<char>(overrides.hasRole);
+        key[n++] = static_cast<char>(overrides.hasRole ? overrides.role : SpeakerSocialRole::Villager);
+        for (unsigned i = 0; i < NPCVoiceOverrides::kSliderCount; ++i)
+        {
+            if (overrides.mask & (1u << i))
+            {
+                std::memcpy(key + n, &overrides.values[i], sizeof(float));
+                n += sizeof(float);
+            }
+        }
+        return std::string(key, n);
+    }
+
+    uint32_t AcquireVoiceVariant(uint32_t archetype, const NPCVoiceOverrides& overrides)
+    {
+        auto inserted = voiceVariantByKey.emplace(VariantKey(archetype, overrides), 0u);
+        if (!inserted.second)
+            return inserted.first->second;
+
+        const uint32_t index = AddVoice(VoiceKind::Variant, *voices[archetype].profile);
+        voices[index].base = archetype;
+        voices[index].overrides = overrides;
+        overrides.ApplyTo(*voices[index].profile);
+        inserted.first->second = index;
+        return index;
+    }
+
+    NPCHandle BindNPC(const std::string& npcId, uint32_t voiceIndex)
+    {
+        ++voices[voiceIndex].users;
+        NPCHandle handle = FindNPC(npcId);
+        if (handle)
+        {
+            ReleaseVoice(npcs[handle.index].voiceIndex);
+        }
+        else
+        {
+            if (!freeNPCSlots.empty())
+            {
+                handle = npcs[freeNPCSlots.back()].handle;
+                freeNPCSlots.pop_back();
+            }
+            else
+            {
+                handle.index = static_cast<uint32_t>(npcs.size());
+                npcs.emplace_back();
+                npcs.back().handle = handle;
+                npcReadyAtSeconds.resize(npcs.size() * kDialogueFunctionCount,
+                                         -std::numeric_limits<double>::infinity());
+                npcCooldownSeconds.resize(npcs.size() * kDialogueFunctionCount, 0.0f);
+                readyPos.resize(npcs.size() * kDialogueFunctionCount, kNotReady);
+            }
+            auto entry = npcHandleById.emplace(npcId, handle).first;
+            npcs[handle.index].npcId = &entry->first;
+            npcs[handle.index].alive = true;
+            for (std::size_t f = 0; f < kDialogueFunctionCount; ++f)
+                MarkReady(handle, static_cast<DialogueFunction>(f));
+        }
+
+        NPCRecord& record = npcs[handle.index];
+        record.voiceIndex = voiceIndex;
+        record.streamKey = StableHash64(npcId);
+        ReleaseRecent(record);
+        RefreshNPCVoice(record);
+        return handle;
+    }
+
+    // Kept per slot as voices change, so StepRumors does not walk every
+    // NPC's profile.
+    void RefreshDistortThreshold(const NPCRecord& npc)
+    {
+        if (npc.handle.index >= rumorDistortThresholds.size())
+            rumorDistortThresholds.resize(npcs.size(), 0);
+        const float chance = npc.alive ? npc.voice->unreliability01 * rumorPolicy.distortionScale : 0.0f;
+        rumorDistortThresholds[npc.handle.index] =
+            static_cast<uint32_t>(std::min<uint64_t>(RumorDiffusion::Threshold(chance), 0xFFFFFFFFull));
+    }
+
+    // Re-derives what the NPC caches from its voice.
+    void RefreshNPCVoice(NPCRecord& npc)
+    {
+        npc.voice = voices[npc.voiceIndex].profile.get();
+        npc.eligibility = AcquireStaticEligibility(*npc.voice);
+        std::copy(npc.voice->cooldownSeconds.begin(), npc.voice->cooldownSeconds.end(),
+                  npcCooldownSeconds.begin() + npc.handle.index * kDialogueFunctionCount);
+        RefreshDistortThreshold(npc);
+    }
+
+    const NPCRecord* ResolveNPC(NPCHandle handle) const
+    {
+        if (handle.index >= npcs.size())
+            return nullptr;
+        const NPCRecord& npc = npcs[handle.index];
+        return npc.alive && npc.handle.generation == handle.generation ? &npc : nullptr;
+    }
+
+    NPCRecord* ResolveNPC(NPCHandle handle)
+    {
+        return const_cast<NPCRecord*>(static_cast<const DialogueSystem*>(this)->ResolveNPC(handle));
+    }
+
+    const NPCRecord* FindNPCRecord(const std::string& npcId) const
+    {
+        const NPCHandle handle = FindNPC(npcId);
+        return handle ? &npcs[handle.index] : nullptr;
+    }
+
+    NPCRecord* FindNPCRecord(const std::string& npcId)
+    {
+        const NPCHandle handle = FindNPC(npcId);
+        return handle ? &npcs[handle.index] : nullptr;
+    }
+
+    // --------------------------------------------------
+    // Stale-state sweeper
+    // --------------------------------------------------
+    // Visits at most `budget` items of each kind: NPC slots (idle NPCs
+    // lose their cached weight trees, which rebuild on the next pick) and
+    // voice slots (unused variants are freed). Emergent events need no
+    // sweeping; their rings are fixed-size.
+    void SweepStaleState(std::size_t budget)
+    {
+        for (std::size_t n = 0; n < budget && !npcs.empty(); ++n)
+        {
+            sweepNPCCursor = (sweepNPCCursor + 1) % npcs.size();
+            NPCRecord& npc = npcs[sweepNPCCursor];
+            if (!npc.alive || !npc.weights || currentTimeSeconds - npc.lastActiveSeconds < sweepPolicy.idleNPCSeconds)
+                continue;
+            auto& buckets = npc.weights->buckets;
+            for (auto it = buckets.begin(); it != buckets.end();)
+            {
+                if (!npc.eligibility->Owns(it->first))
+                {
+                    it = buckets.erase(it);
+                    continue;
+                }
+                if (it->second.version != kStaleWeights)
+                {
+                    it->second.tree = FenwickTree();
+                    it->second.version = kStaleWeights;
+                }
+                ++it;
+            }
+        }
+
+        for (std::size_t n = 0; n < budget && !voices.empty(); ++n)
+        {
+            sweepVoiceCursor = (sweepVoiceCursor + 1) % voices.size();
+            VoiceRecord& v = voices[sweepVoiceCursor];
+            if (v.profile && v.kind == VoiceKind::Variant && v.users == 0)
+                FreeVoice(sweepVoiceCursor);
+        }
+    }
+
+    static bool PassesRoleFilter(const DialogueTemplate& t, SpeakerSocialRole role)
+    {
+        if (t.allowedRoles.empty())
+            return true;
+        for (auto r : t.allowedRoles)
+        {
+            if (r == role)
+                return true;
+        }
+        return false;
+    }
+
+    // Region filter (soft: ForestVillage templates and contexts match anything).
+    static bool PassesRegionFilter(const DialogueTemplate& t, RegionTone ctxTone)
+    {
+        return t.regionTone == ctxTone ||
+               t.regionTone == RegionTone::ForestVillage ||
+               ctxTone == RegionTone::ForestVillage;
+    }
+
+    StaticEligibility* AcquireStaticEligibility(const NPCVoiceProfile& profile)
+    {
+        for (const auto& set : eligibilitySets)
+        {
+            if (set->role == profile.role)
+                return set.get();
+        }
+
+        auto set = std::make_unique<StaticEligibility>();
+        set->role = profile.role;
+        for (uint32_t i = 0; i < templates.size(); ++i)
+            InsertIntoEligibility(*set, i);
+
+        eligibilitySets.push_back(std::move(set));
+        return eligibilitySets.back().get();
+    }
+
+    void InsertIntoEligibility(StaticEligibility& set, uint32_t index) const
+    {
+        const DialogueTemplate& t = templates[index];
+        if (!PassesRoleFilter(t, set.role))
+            return;
+
+        auto& byTone = set.buckets[static_cast<std::size_t>(t.function)];
+        for (std::size_t tone = 0; tone < kRegionToneCount; ++tone)
+        {
+            if (PassesRegionFilter(t, static_cast<RegionTone>(tone)))
+            {
+                byTone[tone].indices.push_back(index);
+                byTone[tone].dirty = true;
+            }
+        }
+    }
+
+    void RefreshBucket(EligibilityBucket& bucket) const
+    {
+        if (!bucket.dirty)
+            return;
+
+        bucket.isStatic = true;
+        bucket.slotOf.clear();
+        std::vector<float> weights;
+        weights.reserve(bucket.indices.size());
+        for (uint32_t slot = 0; slot < bucket.indices.size(); ++slot)
+        {
+            const uint32_t index = bucket.indices[slot];
+            bucket.isStatic = bucket.isStatic && compiledTemplates[index].contextFree;
+            bucket.slotOf[index] = slot;
+            weights.push_back(templates[index].weight * weightScales[index]);
+        }
+
+        if (bucket.isStatic)
+            bucket.alias.Build(weights);
+        bucket.modulated = false;
+        bucket.weightVersion++;
+        bucket.dirty = false;
+    }
+
+    void UpdateBucketWeight(EligibilityBucket& bucket, uint32_t index) const
+    {
+        if (bucket.dirty)
+            return;
+        auto slot = bucket.slotOf.find(index);
+        if (slot == bucket.slotOf.end())
+            return;
+
+        const float weight = templates[index].weight * weightScales[index];
+        if (bucket.isStatic && !bucket.modulated)
+        {
+            std::vector<float> weights;
+            weights.reserve(bucket.indices.size());
+            for (uint32_t i : bucket.indices)
+                weights.push_back(templates[i].weight * weightScales[i]);
+            bucket.weighted.Build(weights);
+            bucket.modulated = true;
+        }
+        else if (bucket.isStatic)
+        {
+            bucket.weighted.Set(slot->second, weight);
+        }
+        bucket.weightVersion++;
+    }
+
+    float EffectiveWeight(uint32_t index, const NPCRecord& npc) const
+    {
+        float w = templates[index].weight * weightScales[index];
+        if (npc.weights)
+        {
+            auto it = npc.weights->scales.find(index);
+            if (it != npc.weights->scales.end())
+                w *= it->second;
+        }
+        return w;
+    }
+
+    bool IsRecent(uint32_t index, const NPCRecord& npc) const
+    {
+        return (npc.recentSlot != kNoRecencyWindow && npcRecent[npc.recentSlot].Contains(index, currentTimeSeconds)) ||
+               globalRecent.Contains(index, currentTimeSeconds);
+    }
+
+    // NPCs get a recency window on their first pick, so NPCs that never
+    // speak don't carry one.
+    void PushRecent(NPCRecord& npc, uint32_t index)
+    {
+        if (recencyPolicy.npcWindowPicks == 0)
+            return;
+        if (npc.recentSlot == kNoRecencyWindow)
+        {
+            if (!freeRecencySlots.empty())
+            {
+                npc.recentSlot = freeRecencySlots.back();
+                freeRecencySlots.pop_back();
+            }
+            else
+            {
+                npc.recentSlot = static_cast<uint32_t>(npcRecent.size());
+                npcRecent.emplace_back();
+            }
+            npcRecent[npc.recentSlot].Configure(recencyPolicy.npcWindowPicks, recencyPolicy.npcWindowSeconds);
+        }
+        npcRecent[npc.recentSlot].Push(index, currentTimeSeconds);
+    }
+
+    void ReleaseRecent(NPCRecord& npc)
+    {
+        if (npc.recentSlot == kNoRecencyWindow)
+            return;
+        freeRecencySlots.push_back(npc.recentSlot);
+        npc.recentSlot = kNoRecencyWindow;
+    }
+
+    // Effective weight with the recency penalty applied.
+    float SampleWeight(uint32_t index, const NPCRecord& npc) const
+    {
+        const float w = EffectiveWeight(index, npc);
+        return IsRecent(index, npc) ? w * recencyPolicy.recentWeightScale : w;
+    }
+
+    uint32_t IndexOf(const DialogueTemplate& t) const
+    {
+        return static_cast<uint32_t>(&t - templates.data());
+    }
+
+    // Swap-and-pop removal; the last template takes over the freed index.
+    void RemoveTemplateAt(uint32_t index)
+    {
+        ++templateEpoch; // template indices shift below
+        const uint32_t last = static_cast<uint32_t>(templates.size() - 1);
+        const auto removedFn = static_cast<std::size_t>(templates[index].function);
+        const auto movedFn = static_cast<std::size_t>(templates[last].function);
+
+        for (auto& set : eligibilitySets)
+        {
+            for (auto& bucket : set->buckets[removedFn])
+            {
+                auto& ids = bucket.indices;
+                auto it = std::find(ids.begin(), ids.end(), index);
+                if (it == ids.end())
+                    continue;
+                ids.erase(it);
+                bucket.dirty = true;
+            }
+
+            // Renaming keeps weights and slots, so alias tables stay valid.
+            if (index == last)
+                continue;
+            for (auto& bucket : set->buckets[movedFn])
+            {
+                std::replace(bucket.indices.begin(), bucket.indices.end(), last, index);
+                auto slot = bucket.slotOf.find(last);
+                if (slot == bucket.slotOf.end())
+                    continue;
+                const uint32_t moved = slot->second;
+                bucket.slotOf.erase(slot);
+                bucket.slotOf[index] = moved;
+            }
+        }
+
+        // Recency windows hold template indices; a reload forgets them.
+        globalRecent.Clear();
+        for (RecencyWindow<8>& window : npcRecent)
+            window.Clear();
+        for (NPCRecord& npc : npcs)
+        {
+            if (!npc.weights)
+                continue;
+            auto& scales = npc.weights->scales;
+            scales.erase(index);
+            auto moved = scales.find(last);
+            if (moved == scales.end())
+                continue;
+            const float scale = moved->second;
+            scales.erase(moved);
+            scales[index] = scale;
+        }
+
+        for (auto& kv : regions)
+            RemoveFromRegion(kv.second, index, last);
+
+        UnindexTemplateDependencies(index);
+        if (index != last)
+            RenameTemplateDependencies(last, index);
+
+        templateIndexById.erase(templates[index].id);
+        if (index != last)
+        {
+            templates[index] = std::move(templates[last]);
+            compiledTemplates[index] = std::move(compiledTemplates[last]);
+            weightScales[index] = weightScales[last];
+            templateIndexById[templates[index].id] = index;
+        }
+        templates.pop_back();
+        compiledTemplates.pop_back();
+        weightScales.pop_back();
+    }
+
+    // --------------------------------------------------
+    // Reverse index and region live sets
+    // --------------------------------------------------
+    CompiledTemplate CompileTemplate(const DialogueTemplate& t)
+    {
+        CompiledTemplate c;
+        for (const auto& tb : t.requiredTabooIds)
+            c.tabooIds.push_back(contextIds.Intern(tb));
+        for (const auto& ev : t.requiredEventIds)
+            c.eventIds.push_back(contextIds.Intern(ev));
+        for (const auto& loc : t.disallowedLocationIds)
+            c.blockedLocationIds.push_back(contextIds.Intern(loc));
+
+        for (auto* ids : { &c.tabooIds, &c.eventIds, &c.blockedLocationIds })
+        {
+            std::sort(ids->begin(), ids->end());
+            ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+        }
+
+        TokenizeText(t.text, c);
+
+        c.contextFree = c.tabooIds.empty() && c.eventIds.empty() &&
+                        c.blockedLocationIds.empty() && !t.condition;
+
+        if (!t.allowedRoles.empty())
+        {
+            c.roleMask = 0;
+            for (auto r : t.allowedRoles)
+                c.roleMask |= static_cast<uint8_t>(1u << static_cast<unsigned>(r));
+        }
+        return c;
+    }
+
+    static void AddDependent(std::vector<std::vector<uint32_t>>& index,
+                             uint32_t id, uint32_t templateIndex)
+    {
+        if (index.size() <= id)
+            index.resize(id + 1);
+        index[id].push_back(templateIndex);
+    }
+
+    void IndexTemplateDependencies(uint32_t index)
+    {
+        const CompiledTemplate& c = compiledTemplates[index];
+        for (uint32_t id : c.tabooIds)           AddDependent(tabooDependents, id, index);
+        for (uint32_t id : c.eventIds)           AddDependent(eventDependents, id, index);
+    }
+
+    void UnindexTemplateDependencies(uint32_t index)
+    {
+        auto drop = [index](std::vector<uint32_t>& deps)
+        {
+            deps.erase(std::remove(deps.begin(), deps.end(), index), deps.end());
+        };
+        const CompiledTemplate& c = compiledTemplates[index];
+        for (uint32_t id : c.tabooIds)           drop(tabooDependents[id]);
+        for (uint32_t id : c.eventIds)           drop(eventDependents[id]);
+    }
+
+    void RenameTemplateDependencies(uint32_t from, uint32_t to)
+    {
+        const CompiledTemplate& c = compiledTemplates[from];
+        for (uint32_t id : c.tabooIds)           std::replace(tabooDependents[id].begin(), tabooDependents[id].end(), from, to);
+        for (uint32_t id : c.eventIds)           std::replace(eventDependents[id].begin(), eventDependents[id].end(), from, to);
+    }
+
+    // Decay in log space: an event passes a severity threshold at time
+    // `now` iff log2(s0) + t0 / h >= log2(threshold) + now / h, so its
+    // score is fixed at notification and a query is one compare per event.
+    double DecayScore(float severity01, double timestampSeconds) const
+    {
+        const double s = std::max(static_cast<double>(severity01), 1e-9);
+        const double h = eventPolicy.severityHalfLifeSeconds;
+        return std::log2(s) + (h > 0.0 ? timestampSeconds / h : 0.0);
+    }
+
+    double DecayCutoff(float minSeverity01) const
+    {
+        return minSeverity01 > 0.0f ? DecayScore(minSeverity01, currentTimeSeconds)
+                                    : -std::numeric_limits<double>::infinity();
+    }
+
+    float DecayedSeverity(const EventRing::Entry& e) const
+    {
+        const double h = eventPolicy.severityHalfLifeSeconds;
+        if (h <= 0.0)
+            return e.severity01;
+        return e.severity01 * static_cast<float>(std::exp2(-(currentTimeSeconds - e.timestampSeconds) / h));
+    }
+
+    std::size_t FirstRetainedEvent(const EventRing& ring, double sinceSeconds) const
+    {
+        return ring.LowerBound(std::max(sinceSeconds, currentTimeSeconds - eventPolicy.retentionSeconds));
+    }
+
+    // Distinct rumors the NPC knows: what it learned through diffusion
+    // (counted per NPC as rumors arrive), plus the context's
+    // knownRumorIds and its region's fresh events that it did not learn
+    // that way. Both lists are sorted, so the same ID from several
+    // sources (or a re-notified event) counts once without sorting.
+    std::size_t CountKnownRumors(const PackedDialogueContext& ctx, const NPCRecord& npc) const
+    {
+        std::size_t count = rumorDiffusion.KnownCount(npc.handle.index) + ctx.unnamedRumors;
+        const RegionLiveState* region = FindRegion(ctx.regionId);
+        const double cutoff = region ? DecayCutoff(eventPolicy.rumorSeverity01) : 0.0;
+        const double oldest = currentTimeSeconds - eventPolicy.retentionSeconds;
+        const FreshRumor* fresh = region ? region->freshRumors.data() : nullptr;
+        const FreshRumor* freshEnd = region ? fresh + region->freshRumors.size() : nullptr;
+        const uint32_t* known = ctx.rumorIds.begin();
+        while (known != ctx.rumorIds.end() || fresh != freshEnd)
+        {
+            uint32_t id;
+            if (fresh == freshEnd || (known != ctx.rumorIds.end() && *known < fresh->eventId))
+            {
+                id = *known++;
+            }
+            else
+            {
+                id = fresh->eventId;
+                const bool inContext = known != ctx.rumorIds.end() && *known == id;
+                // The ring's own test (see QueryRegionEvents), not freshUntil.
+                const bool stale = fresh->decayScore < cutoff || fresh->timestampSeconds < oldest;
+                ++fresh;
+                if (inContext)
+                    ++known;
+                else if (stale)
+                    continue;
+            }
+            if (!KnowsThroughDiffusion(npc, id))
+                ++count;
+        }
+        return count;
+    }
+
+    bool KnowsThroughDiffusion(const NPCRecord& npc, uint32_t contextId) const
+    {
+        return contextId < rumorByContextId.size() && rumorByContextId[contextId] != kNoRumor &&
+               rumorDiffusion.Knows(npc.handle.index, rumorByContextId[contextId], nullptr);
+    }
+
+    // Keeps the region's fresh events (sorted by ID) current: `e` extends
+    // its event's entry; entries that went stale are dropped.
+    void NoteFreshRumor(RegionLiveState& region, const EventRing::Entry& e)
+    {
+        std::vector<FreshRumor>& list = region.freshRumors;
+        list.erase(std::remove_if(list.begin(), list.end(),
+                                  [this](const FreshRumor& f) { return f.freshUntilSeconds < currentTimeSeconds; }),
+                   list.end());
+        const FreshRumor entry{ e.eventId, FreshUntilSeconds(e), e.timestampSeconds, e.decayScore };
+        if (entry.freshUntilSeconds < currentTimeSeconds)
+            return;
+        auto it = std::lower_bound(list.begin(), list.end(), e.eventId,
+                                   [](const FreshRumor& f, uint32_t id) { return f.eventId < id; });
+        if (it == list.end() || it->eventId != e.eventId)
+            list.insert(it, entry);
+        else if (entry.freshUntilSeconds > it->freshUntilSeconds)
+            *it = entry;
+    }
+
+    // Time at which the event stops counting as a rumor: it decays below
+    // rumorSeverity01 or falls out of the retention window.
+    double FreshUntilSeconds(const EventRing::Entry& e) const
+    {
+        double until = e.timestampSeconds + eventPolicy.retentionSeconds;
+        const double h = eventPolicy.severityHalfLifeSeconds;
+        if (h > 0.0 && eventPolicy.rumorSeverity01 > 0.0f)
+        {
+            const double s = std::max(static_cast<double>(e.severity01), 1e-9);
+            until = std::min(until, e.timestampSeconds + h * std::log2(s / eventPolicy.rumorSeverity01));
+        }
+        else if (e.severity01 < eventPolicy.rumorSeverity01)
+        {
+            until = e.timestampSeconds;
+        }
+        return until;
+    }
+
+    static uint64_t EventExpiryPayload(const RegionLiveState& region, uint32_t eventId)
+    {
+        return (static_cast<uint64_t>(region.context->packed.regionId) << 32) | eventId;
+    }
+
+    void SetRegionEventActive(RegionLiveState& region, uint32_t id, bool active)
+    {
+        if (ToggleRegionId(region, region.activeEventIds, eventDependents, id, active))
+            EditRegionContext(region, [&](PackedDialogueContext& ctx) { ctx.eventIds.Set(id, active); });
+    }
+
+    const RegionLiveState* FindRegion(uint32_t regionId) const
+    {
+        return regionId < regionByContextId.size() ? regionByContextId[regionId] : nullptr;
+    }
+
+    const RegionLiveState* FindRegion(const std::string& regionId) const
+    {
+        if (regionId.empty())
+            return nullptr;
+        auto it = regions.find(regionId);
+        return it == regions.end() ? nullptr : &it->second;
+    }
+
+    RegionLiveState& AcquireRegion(const std::string& regionId)
+    {
+        auto it = regions.find(regionId);
+        if (it != regions.end())
+            return it->second;
+
+        RegionLiveState& region = regions[regionId];
+        region.events.SetCapacity(eventPolicy.perRegionCapacity);
+        region.context = std::make_shared<RegionContextSnapshot>();
+        region.context->packed.regionId = contextIds.Intern(regionId);
+        region.context->version = ++regionContextVersion;
+
+        const uint32_t id = region.context->packed.regionId;
+        if (id >= regionByContextId.size())
+            regionByContextId.resize(id + 1, nullptr);
+        regionByContextId[id] = &region;
+        for (uint32_t i = 0; i < templates.size(); ++i)
+            InsertIntoRegion(region, i);
+        return region;
+    }
+
+    void InsertIntoRegion(RegionLiveState& region, uint32_t index) const
+    {
+        const CompiledTemplate& c = compiledTemplates[index];
+        uint16_t missing = 0;
+        for (uint32_t id : c.tabooIds) missing += region.activeTabooIds.count(id) ? 0 : 1;
+        for (uint32_t id : c.eventIds) missing += region.activeEventIds.count(id) ? 0 : 1;
+
+        region.missing.push_back(missing);
+        region.livePos.push_back(RegionLiveState::kNotLive);
+        if (missing == 0)
+            MarkLive(region, index);
+    }
+
+    void RemoveFromRegion(RegionLiveState& region, uint32_t index, uint32_t last) const
+    {
+        if (region.livePos[index] != RegionLiveState::kNotLive)
+            MarkNotLive(region, index);
+
+        if (index != last)
+        {
+            const uint32_t pos = region.livePos[last];
+            if (pos != RegionLiveState::kNotLive)
+                region.live[static_cast<std::size_t>(templates[last].function)][pos] = index;
+            region.missing[index] = region.missing[last];
+            region.livePos[index] = pos;
+        }
+        region.missing.pop_back();
+        region.livePos.pop_back();
+    }
+
+    void MarkLive(RegionLiveState& region, uint32_t index) const
+    {
+        auto& live = region.live[static_cast<std::size_t>(templates[index].function)];
+        region.livePos[index] = static_cast<uint32_t>(live.size());
+        live.push_back(index);
+    }
+
+    void MarkNotLive(RegionLiveState& region, uint32_t index) const
+    {
+        auto& live = region.live[static_cast<std::size_t>(templates[index].function)];
+        const uint32_t pos = region.livePos[index];
+        const uint32_t moved = live.back();
+        live[pos] = moved;
+        region.livePos[moved] = pos;
+        live.pop_back();
+        region.livePos[index] = RegionLiveState::kNotLive;
+    }
+
+    // O(templates referencing id).
+    // Returns false if the ID already had that state.
+    bool ToggleRegionId(RegionLiveState& region,
+                        std::unordered_set<uint32_t>& activeIds,
+                        const std::vector<std::vector<uint32_t>>& dependents,
+                        uint32_t id,
+                        bool active) const
+    {
+        const bool wasActive = activeIds.count(id) > 0;
+        if (wasActive == active)
+            return false;
+
+        if (active)
+            activeIds.insert(id);
+        else
+            activeIds.erase(id);
+
+        if (id >= dependents.size())
+            return true;
+
+        for (uint32_t index : dependents[id])
+        {
+            if (active)
+            {
+                if (--region.missing[index] == 0)
+                    MarkLive(region, index);
+            }
+            else
+            {
+                if (region.missing[index]++ == 0)
+                    MarkNotLive(region, index);
+            }
+        }
+        return true;
+    }
+
+    // Applies `edit` to the region's packed snapshot, copied first if
+    // anyone else still holds it. The copy shares spilled ID lists.
+    template <typename Edit>
+    void EditRegionContext(RegionLiveState& region, Edit&& edit)
+    {
+        if (region.context.use_count() > 1)
+            region.context = std::make_shared<RegionContextSnapshot>(*region.context);
+        edit(region.context->packed);
+        region.context->version = ++regionContextVersion;
+    }
+
+    // Snapshot plus overlay. An overlay only touches the flag word and
+    // the threat byte, so merging is a copy of the packed snapshot.
+    static PackedDialogueContext ResolveOverlay(const RegionContextSnapshot& base, const DialogueContextOverlay& overlay)
+    {
+        PackedDialogueContext ctx = base.packed;
+        overlay.ApplyTo(ctx);
+        return ctx;
+    }
+
+    void PackContextFields(const DialogueContext& ctx, PackedDialogueContext& p) const
+    {
+        using Packed = PackedDialogueContext;
+        p.threat = Packed::QuantizeThreat(ctx.threatLevel01);
+        p.regionTone = ctx.regionTone;
+        p.Set(Packed::Indoors, ctx.isIndoors);
+        p.Set(Packed::Night, ctx.isNight);
+        p.Set(Packed::PlayerRecentlyBrokeTaboo, ctx.playerRecentlyBrokeTaboo);
+        p.Set(Packed::PlayerLowHealth, ctx.playerLowHealth);
+        p.Set(Packed::PlayerIsBleeding, ctx.playerIsBleeding);
+        p.Set(Packed::InSafeRoom, ctx.inSafeRoomFlagged);
+        p.locationId = ctx.locationId.empty() ? IdInterner::kInvalid : contextIds.Find(ctx.locationId);
+        p.regionId = ctx.regionId.empty() ? IdInterner::kInvalid : contextIds.Find(ctx.regionId);
+    }
+
+    // Fills `out` with the IDs of the known names; returns how many were
+    // unknown.
+    uint32_t FindContextIds(const std::unordered_set<std::string>& names, std::vector<uint32_t>& out) const
+    {
+        out.clear();
+        uint32_t unknown = 0;
+        for (const std::string& name : names)
+        {
+            const uint32_t id = contextIds.Find(name);
+            if (id == IdInterner::kInvalid)
+                ++unknown;
+            else
+                out.push_back(id);
+        }
+        return unknown;
+    }
+
+    // PackContext for the string-ID GenerateLine forms: lists longer than
+    // PackedIdList::kInline are views into scratch vectors, so packing
+    // does not allocate once they have grown. Valid until the next call.
+    const PackedDialogueContext& PackContextScratch(const DialogueContext& ctx)
+    {
+        PackedDialogueContext& p = packScratch.packed;
+        PackContextFields(ctx, p);
+        FindContextIds(ctx.activeTabooIds, packScratch.taboos);
+        p.tabooIds.AssignView(packScratch.taboos);
+        FindContextIds(ctx.recentEventIds, packScratch.events);
+        p.eventIds.AssignView(packScratch.events);
+        p.unnamedRumors = FindContextIds(ctx.knownRumorIds, packScratch.rumors);
+        p.rumorIds.AssignView(packScratch.rumors);
+        return p;
+    }
+
+    bool IsLocationBlocked(uint32_t index, uint32_t locationId) const
+    {
+        if (locationId == IdInterner::kInvalid)
+            return false;
+        const auto& blocked = compiledTemplates[index].blockedLocationIds;
+        return std::binary_search(blocked.begin(), blocked.end(), locationId);
+    }
+
+    // --------------------------------------------------
+    // Line generation
+    // --------------------------------------------------
+    // Walks the ladder and returns the first tier's pick, with cooldown and
+    // recency already updated. Realization is separate so it can be deferred.
+    const DialogueTemplate* SelectLine(NPCRecord& npc,
+                                       TriggerId trigger,
+                                       const PackedDialogueContext& ctx,
+                                       const FallbackLadder& fallback,
+                                       RNG& rng,
+                                       DialogueFunction& outFunction)
+    {
+        // Cooldowns and throttles first: if nothing the trigger or the
+        // ladder could pick may fire, skip the rule evaluation.
+        uint16_t reachable = ReachableFunctions(trigger);
+        for (std::size_t i = 0; i < fallback.count; ++i)
+            reachable |= FunctionBit(fallback.tiers[i]);
+        if (!AnyMayFire(npc, reachable))
+            return nullptr;
+
+        // Map triggerTag to a target function, then append the fallbacks
+        FallbackLadder ladder;
+        ladder.Then(MapTriggerToFunction(trigger, ctx, npc));
+        for (std::size_t i = 0; i < fallback.count; ++i)
+            ladder.Then(fallback.tiers[i]);
+
+        std::vector<const DialogueTemplate*> candidates; // materialized mode only
+        for (std::size_t i = 0; i < ladder.count; ++i)
+        {
+            const DialogueFunction fn = ladder.tiers[i];
+
+            // Cooldown and group throttle checks
+            if (!CanFire(npc, fn) || !ThrottlesAllow(npc, fn))
+                continue;
+
+            // Weighted random pick among valid templates
+            const DialogueTemplate* chosen = PickCandidate(ctx, npc, fn, candidates, rng);
+            if (!chosen)
+                continue;
+
+            // Record cooldown timestamp, throttle tokens and recency
+            npc.lastActiveSeconds = currentTimeSeconds;
+            TouchCooldown(npc, fn);
+            ConsumeThrottles(npc, fn);
+            PushRecent(npc, IndexOf(*chosen));
+            globalRecent.Push(IndexOf(*chosen), currentTimeSeconds);
+
+            outFunction = fn;
+            return chosen;
+        }
+
+        return nullptr;
+    }
 
-        // Collect valid templates
-        std::vector<const DialogueTemplate*> candidates;
-        CollectCandidates(ctx, *profile, desiredFunction, candidates);
+    // Selects and realizes into `buffer`. With `overflow`, a line that does
+    // not fit is realized again (same draws) into *overflow, doubling its
+    // size until it does; the result then views *overflow.
+    DialogueLineResult GenerateLineInto(NPCHandle handle,
+                                        TriggerId trigger,
+                                        const PackedDialogueContext& ctx,
+                                        char* buffer,
+                                        std::size_t capacity,
+                                        const FallbackLadder& fallback,
+                                        std::string* overflow)
+    {
+        NPCRecord* npc = ResolveNPC(handle);
+        if (!npc || trigger.index >= triggerTable.size()) return DialogueLineResult();
 
-        if (candidates.empty())
-            return std::string();
+        const uint64_t sequence = npc->triggerSequence++;
+        RNG rng(RNG::StreamKey(sessionSeed, npc->streamKey, sequence));
+        DialogueFunction fn = DialogueFunction::NeutralAmbient;
+        const DialogueTemplate* chosen = SelectLine(*npc, trigger, ctx, fallback, rng, fn);
 
-        // Weighted random pick
-        const DialogueTemplate* chosen = PickTemplateWeighted(candidates);
-        if (!chosen)
-            return std::string();
+        LineBuffer out(buffer, capacity);
+        DialogueLineResult result;
+        if (chosen)
+        {
+            result = RealizeLine(*chosen, fn, ctx, *npc->voice, rng, out);
+            for (std::size_t size = capacity * 2; overflow && result.truncated; size *= 2)
+            {
+                overflow->resize(size);
+                LineBuffer larger(&(*overflow)[0], size);
+                result = RealizeLine(*chosen, fn, ctx, *npc->voice, rng, larger);
+            }
+        }
 
-        // Record cooldown timestamp
-        TouchCooldown(profile->npcId, desiredFunction);
+        if (recording)
+        {
+            DialogueReplayEntry& e = RecordEntry(DialogueReplayEntry::Kind::GenerateLine);
+            e.npcId = *npc->npcId;
+            e.triggerTag = triggerTable[trigger.index].tag;
+            e.triggerSequence = sequence;
+            e.ctx = UnpackContext(ctx);
+            e.fallback = fallback;
+            e.line = std::string(result.text);
+        }
+        return result;
+    }
 
-        // Generate surface text with substitutions and stylistic passes
-        std::string line = RealizeTemplate(*chosen, ctx, *profile);
+    // Generate surface text with substitutions and stylistic passes
+    DialogueLineResult RealizeLine(const DialogueTemplate& chosen,
+                                   DialogueFunction fn,
+                                   const PackedDialogueContext& ctx,
+                                   const NPCVoiceProfile& profile,
+                                   RNG rng,
+                                   LineBuffer& out)
+    {
+        RealizeTemplate(chosen, ctx, profile, rng, out);
 
-        return line;
+        DialogueLineResult result;
+        result.text = out.View();
+        result.templateId = chosen.id;
+        result.reliability = chosen.reliability;
+        result.function = fn;
+        result.truncated = out.Overflowed();
+        return result;
     }
 
-    // Hook for registering emergent events as rumor seeds, etc.
-    void NotifyEvent(const std::string& eventId,
-                     const std::string& regionId,
-                     float severity01)
+    DialogueReplayEntry& RecordEntry(DialogueReplayEntry::Kind kind)
     {
-        EmergentEvent e;
-        e.eventId = eventId;
-        e.regionId = regionId;
-        e.severity01 = severity01;
-        e.timestampSeconds = currentTimeSeconds;
-        emergentEvents.push_back(e);
+        sessionLog.entries.emplace_back();
+        DialogueReplayEntry& e = sessionLog.entries.back();
+        e.kind = kind;
+        e.timeSeconds = currentTimeSeconds;
+        return e;
     }
 
-private:
-    struct EmergentEvent
+    // --------------------------------------------------
+    // Trigger → Function mapping
+    // --------------------------------------------------
+    void RegisterDefaultTriggers()
     {
-        std::string eventId;
-        std::string regionId;
-        float       severity01 = 0.0f;
-        double      timestampSeconds = 0.0;
-    };
+        using In = TriggerRule::Input;
+        using Cmp = TriggerRule::Compare;
+        const auto always = [](DialogueFunction fn) { return TriggerRule{ In::Always, Cmp::Greater, 0.0f, fn }; };
 
-    RNG rng;
-    double currentTimeSeconds = 0.0;
+        // TriggerId 0: unknown trigger. Fallback: choose something mood‑aligned
+        InternTrigger(std::string());
+        SetTriggerRules(std::string(), {
+            { In::ThreatLevel, Cmp::Greater, 0.6f, DialogueFunction::Dread },
+            { In::KnownRumorCount, Cmp::Greater, 0.0f, DialogueFunction::Rumor },
+            always(DialogueFunction::NeutralAmbient) });
 
-    std::unordered_map<std::string, NPCVoiceProfile> npcProfiles;
-    std::vector<DialogueTemplate> templates;
-    std::vector<EmergentEvent> emergentEvents;
+        // High‑priority explicit triggers
+        SetTriggerRules("on_enemy_spotted",       { always(DialogueFunction::ThreatBark) });
+        SetTriggerRules("on_player_pain",         { always(DialogueFunction::Pain) });
+        SetTriggerRules("on_player_surprised",    { always(DialogueFunction::Surprise) });
+        SetTriggerRules("on_player_breaks_taboo", { always(DialogueFunction::RitualHint) });
 
-    // Per‑NPC per‑function last fire time
-    struct CooldownKey
-    {
-        std::string npcId;
-        DialogueFunction function;
+        // Choose between dread vs rumor based on superstition
+        SetTriggerRules("on_night_heartbeat", {
+            { In::Superstition, Cmp::Greater, 0.6f, DialogueFunction::Dread },
+            always(DialogueFunction::Rumor) });
+        SetTriggerRules("on_enter_safehouse", {
+            { In::Bureaucratic, Cmp::Greater, 0.5f, DialogueFunction::Bureaucratic },
+            always(DialogueFunction::NeutralAmbient) });
+    }
 
-        bool operator==(const CooldownKey& other) const
+    // Rules are stored as "(value > t or value >= t) xor negate", so
+    // evaluation is a table load, one compare and no branching on the op.
+    static CompiledTriggerRule CompileTriggerRule(const TriggerRule& r)
+    {
+        CompiledTriggerRule c;
+        c.input = static_cast<uint8_t>(r.input);
+        c.threshold = r.threshold;
+        c.function = r.function;
+        // Threat is read from the packed context; compare on its grid.
+        if (r.input == TriggerRule::Input::ThreatLevel && r.threshold >= 0.0f && r.threshold <= 1.0f)
+            c.threshold = PackedDialogueContext::QuantizeThreat(r.threshold) / 255.0f;
+        switch (r.compare)
         {
-            return npcId == other.npcId && function == other.function;
+            case TriggerRule::Compare::Greater:      c.inclusive = false; c.negate = false; break;
+            case TriggerRule::Compare::GreaterEqual: c.inclusive = true;  c.negate = false; break;
+            case TriggerRule::Compare::Less:         c.inclusive = true;  c.negate = true;  break;
+            case TriggerRule::Compare::LessEqual:    c.inclusive = false; c.negate = true;  break;
         }
-    };
+        return c;
+    }
 
-    struct CooldownKeyHasher
+    void CompactTriggerRules()
     {
-        std::size_t operator()(const CooldownKey& key) const
+        std::vector<CompiledTriggerRule> live;
+        live.reserve(triggerRules.size() - deadTriggerRules);
+        for (TriggerEntry& entry : triggerTable)
         {
-            std::hash<std::string> h1;
-            std::hash<int> h2;
-            return (h1(key.npcId) ^ (h2(static_cast<int>(key.function)) << 1));
+            const uint32_t first = static_cast<uint32_t>(live.size());
+            live.insert(live.end(),
+                        triggerRules.begin() + entry.firstRule,
+                        triggerRules.begin() + entry.firstRule + entry.ruleCount);
+            entry.firstRule = first;
         }
-    };
-
-    std::unordered_map<CooldownKey, double, CooldownKeyHasher> lastFireTimestamps;
+        triggerRules.swap(live);
+        deadTriggerRules = 0;
+    }
 
-private:
-    // --------------------------------------------------
-    // Template loading / initialization
-    // --------------------------------------------------
-    void InitializeDefaultTemplates()
+    static bool RulePasses(const CompiledTriggerRule& r, float v)
     {
-        // In production you would load these from Loreway YAML/JSON,
-        // already tagged with KG IDs and reliability flags.[file:1]
+        return ((v > r.threshold) | (r.inclusive & (v == r.threshold))) != r.negate;
+    }
 
-        // Example: short dread line, forest village, generic villager.
-        DialogueTemplate t1;
-        t1.id = "ONB_FOREST_DREAD_01";
-        t1.function = DialogueFunction::Dread;
-        t1.reliability = ReliabilityTag::Unknown;
-        t1.regionTone = RegionTone::ForestVillage;
-        t1.allowedRoles = { SpeakerSocialRole::Villager, SpeakerSocialRole::Hermit };
-        t1.text = "The trees remember what the village forgets.";
-        t1.weight = 2.0f;
-        t1.condition = [](const DialogueContext& ctx, const NPCVoiceProfile&)
+    // Index of the first passing rule in [first, first + count), or count.
+    uint32_t FirstPassingRule(uint32_t first,
+                              uint32_t count,
+                              const std::array<float, kTriggerInputCount>& inputs) const
+    {
+        uint32_t i = 0;
+        for (; i < count; ++i)
         {
-            return ctx.isNight && ctx.threatLevel01 > 0.3f;
-        };
-        templates.push_back(t1);
+            const CompiledTriggerRule& r = triggerRules[first + i];
+            if (RulePasses(r, inputs[r.input]))
+                break;
+        }
+        return i;
+    }
 
-        // Example: explicit lie about disappearances, flagged KnownFalse
-        DialogueTemplate t2;
-        t2.id = "ONB_VILLAGER_LIE_DISAPPEAR";
-        t2.function = DialogueFunction::Misdirection;
-        t2.reliability = ReliabilityTag::KnownFalse;
-        t2.regionTone = RegionTone::ForestVillage;
-        t2.allowedRoles = { SpeakerSocialRole::Villager };
-        t2.requiredEventIds = { "EV_WELL_COLLAPSE_ASHDITCH" };
-        t2.text = "No one has gone missing since they fixed the wires.";
-        t2.weight = 1.0f;
-        t2.condition = [](const DialogueContext& ctx, const NPCVoiceProfile&)
-        {
-            return ctx.isNight; // later, KG can confirm this conflicts with posters
-        };
-        templates.push_back(t2);
+    static uint16_t FunctionBit(DialogueFunction fn)
+    {
+        return static_cast<uint16_t>(1u << static_cast<unsigned>(fn));
+    }
 
-        // Example: ritual hint line tied to a taboo
-        DialogueTemplate t3;
-        t3.id = "ONB_RITUAL_HINT_WHISTLE";
-        t3.function = DialogueFunction::RitualHint;
-        t3.reliability = ReliabilityTag::Partial;
-        t3.regionTone = RegionTone::ForestVillage;
-        t3.allowedRoles = { SpeakerSocialRole::Villager, SpeakerSocialRole::Priest };
-        t3.requiredTabooIds = { "TABS_WHISTLE_AT_NIGHT" };
-        t3.text = "If the branches start singing, count your teeth and keep walking.";
-        t3.weight = 1.5f;
-        t3.condition = [](const DialogueContext& ctx, const NPCVoiceProfile&)
-        {
-            return ctx.isNight && ctx.threatLevel01 > 0.2f;
-        };
-        templates.push_back(t3);
+    // Functions MapTriggerToFunction can return for `trigger`.
+    uint16_t ReachableFunctions(TriggerId trigger) const
+    {
+        const TriggerEntry& entry = triggerTable[trigger.index];
+        if (entry.exhaustive)
+            return entry.functions;
+        const TriggerEntry& unknown = triggerTable[0];
+        const uint16_t ambient = unknown.exhaustive ? 0 : FunctionBit(DialogueFunction::NeutralAmbient);
+        return static_cast<uint16_t>(entry.functions | unknown.functions | ambient);
+    }
 
-        // Example: bureaucratic tone, block apartment
-        DialogueTemplate t4;
-        t4.id = "BUREAU_FLAT_NOTICE_01";
-        t4.function = DialogueFunction::Bureaucratic;
-        t4.reliability = ReliabilityTag::Truthful;
-        t4.regionTone = RegionTone::SovietApartment;
-        t4.allowedRoles = { SpeakerSocialRole::Bureaucrat, SpeakerSocialRole::Doctor };
-        t4.text = "If you hear singing in the stairwell, do not open your door. The building committee is handling it.";
-        t4.weight = 1.0f;
-        t4.condition = [](const DialogueContext& ctx, const NPCVoiceProfile&)
-        {
-            return ctx.isIndoors && ctx.isNight;
-        };
-        templates.push_back(t4);
+    // The rumor count is the one costly input; it is only computed for
+    // triggers whose rules read it.
+    DialogueFunction MapTriggerToFunction(TriggerId trigger,
+                                          const PackedDialogueContext& ctx,
+                                          const NPCRecord& npc) const
+    {
+        const TriggerEntry& entry = triggerTable[trigger.index];
+        const TriggerEntry& unknown = triggerTable[0];
+        const NPCVoiceProfile& profile = *npc.voice;
+        std::array<float, kTriggerInputCount> inputs;
+        for (std::size_t i = 0; i < NPCVoiceOverrides::kSliderCount; ++i)
+            inputs[i] = profile.*kVoiceSliderFields[i];
+        using Packed = PackedDialogueContext;
+        inputs[static_cast<std::size_t>(TriggerRule::Input::ThreatLevel)] = ctx.ThreatLevel01();
+        inputs[static_cast<std::size_t>(TriggerRule::Input::IsIndoors)] = ctx.Has(Packed::Indoors);
+        inputs[static_cast<std::size_t>(TriggerRule::Input::IsNight)] = ctx.Has(Packed::Night);
+        inputs[static_cast<std::size_t>(TriggerRule::Input::PlayerRecentlyBrokeTaboo)] = ctx.Has(Packed::PlayerRecentlyBrokeTaboo);
+        inputs[static_cast<std::size_t>(TriggerRule::Input::PlayerLowHealth)] = ctx.Has(Packed::PlayerLowHealth);
+        inputs[static_cast<std::size_t>(TriggerRule::Input::PlayerIsBleeding)] = ctx.Has(Packed::PlayerIsBleeding);
+        inputs[static_cast<std::size_t>(TriggerRule::Input::InSafeRoom)] = ctx.Has(Packed::InSafeRoom);
+        float& rumorCount = inputs[static_cast<std::size_t>(TriggerRule::Input::KnownRumorCount)];
+        rumorCount = entry.readsRumorCount ? static_cast<float>(CountKnownRumors(ctx, npc)) : 0.0f;
+        inputs[static_cast<std::size_t>(TriggerRule::Input::Always)] = 1.0f;
 
-        // Example: pain bark with small body substitution
-        DialogueTemplate t5;
-        t5.id = "GENERIC_PAIN_01";
-        t5.function = DialogueFunction::Pain;
-        t5.reliability = ReliabilityTag::Truthful;
-        t5.text = "Hold still. You're leaking like the old well.";
-        t5.weight = 3.0f;
-        t5.condition = [](const DialogueContext& ctx, const NPCVoiceProfile&)
-        {
-            return ctx.playerIsBleeding;
-        };
-        templates.push_back(t5);
+        const uint32_t hit = FirstPassingRule(entry.firstRule, entry.ruleCount, inputs);
+        if (hit < entry.ruleCount)
+            return triggerRules[entry.firstRule + hit].function;
 
-        // You can keep adding templates or load them from external data here.
+        if (unknown.readsRumorCount && !entry.readsRumorCount)
+            rumorCount = static_cast<float>(CountKnownRumors(ctx, npc));
+        const uint32_t fallback = FirstPassingRule(unknown.firstRule, unknown.ruleCount, inputs);
+        if (fallback < unknown.ruleCount)
+            return triggerRules[unknown.firstRule + fallback].function;
+        return DialogueFunction::NeutralAmbient;
     }
 
     // --------------------------------------------------
-    // Trigger → Function mapping
+    // Cooldown handling
     // --------------------------------------------------
-    DialogueFunction MapTriggerToFunction(const std::string& triggerTag,
-                                          const DialogueContext& ctx,
-                                          const NPCVoiceProfile& profile) const
+    static std::size_t ThrottleSlot(ThrottleGroupId group, DialogueFunction fn)
     {
-        // High‑priority explicit triggers
-        if (triggerTag == "on_enemy_spotted")
-            return DialogueFunction::ThreatBark;
-        if (triggerTag == "on_player_pain")
-            return DialogueFunction::Pain;
-        if (triggerTag == "on_player_surprised")
-            return DialogueFunction::Surprise;
+        return group * kDialogueFunctionCount + static_cast<std::size_t>(fn);
+    }
 
-        if (triggerTag == "on_player_breaks_taboo")
-            return DialogueFunction::RitualHint;
+    // Tokens the bucket holds once refilled to the current time.
+    float AvailableTokens(const ThrottleBucket& bucket) const
+    {
+        const double elapsed = currentTimeSeconds - bucket.lastRefillSeconds;
+        if (elapsed <= 0.0)
+            return bucket.tokens;
+        return static_cast<float>(std::min<double>(bucket.limit.burst,
+                                                   bucket.tokens + elapsed * bucket.limit.ratePerSecond));
+    }
 
-        if (triggerTag == "on_night_heartbeat")
-        {
-            // Choose between dread vs rumor based on superstition
-            if (profile.superstition01 > 0.6f)
-                return DialogueFunction::Dread;
-            return DialogueFunction::Rumor;
-        }
+    // Lazily refills the bucket and reports whether one token is available.
+    bool RefillThrottle(ThrottleGroupId group, DialogueFunction fn)
+    {
+        if (group == kNoThrottleGroup)
+            return true;
+        ThrottleBucket& bucket = throttleBuckets[ThrottleSlot(group, fn)];
+        if (bucket.limit.burst <= 0.0f)
+            return true;
+
+        bucket.tokens = AvailableTokens(bucket);
+        bucket.lastRefillSeconds = currentTimeSeconds;
+        return bucket.tokens >= 1.0f;
+    }
+
+    // RefillThrottle without touching the bucket.
+    bool HasThrottleToken(ThrottleGroupId group, DialogueFunction fn) const
+    {
+        if (group == kNoThrottleGroup)
+            return true;
+        const ThrottleBucket& bucket = throttleBuckets[ThrottleSlot(group, fn)];
+        return bucket.limit.burst <= 0.0f || AvailableTokens(bucket) >= 1.0f;
+    }
 
-        if (triggerTag == "on_enter_safehouse")
+    // True if some function in `functions` is off cooldown and has
+    // throttle tokens for the NPC.
+    bool AnyMayFire(const NPCRecord& npc, uint16_t functions) const
+    {
+        for (std::size_t f = 0; f < kDialogueFunctionCount; ++f)
         {
-            if (profile.bureaucratic01 > 0.5f)
-                return DialogueFunction::Bureaucratic;
-            return DialogueFunction::NeutralAmbient;
+            const DialogueFunction fn = static_cast<DialogueFunction>(f);
+            if ((functions & FunctionBit(fn)) && CanFire(npc, fn) &&
+                HasThrottleToken(npc.squadGroup, fn) && HasThrottleToken(npc.regionGroup, fn) &&
+                HasThrottleToken(kGlobalThrottleGroup, fn))
+                return true;
         }
+        return false;
+    }
 
-        // Fallback: choose something mood‑aligned
-        if (ctx.threatLevel01 > 0.6f)
-            return DialogueFunction::Dread;
-        if (!ctx.knownRumorIds.empty())
-            return DialogueFunction::Rumor;
+    bool ThrottlesAllow(const NPCRecord& npc, DialogueFunction fn)
+    {
+        return RefillThrottle(npc.squadGroup, fn) &&
+               RefillThrottle(npc.regionGroup, fn) &&
+               RefillThrottle(kGlobalThrottleGroup, fn);
+    }
 
-        return DialogueFunction::NeutralAmbient;
+    // Only called after ThrottlesAllow, so every limited bucket has a token.
+    void ConsumeThrottles(const NPCRecord& npc, DialogueFunction fn)
+    {
+        for (ThrottleGroupId group : { npc.squadGroup, npc.regionGroup, kGlobalThrottleGroup })
+        {
+            if (group == kNoThrottleGroup)
+                continue;
+            ThrottleBucket& bucket = throttleBuckets[ThrottleSlot(group, fn)];
+            if (bucket.limit.burst > 0.0f)
+                bucket.tokens -= 1.0f;
+        }
     }
 
-    // --------------------------------------------------
-    // Cooldown handling
-    // --------------------------------------------------
-    bool CanFire(const NPCVoiceProfile& profile, DialogueFunction fn)
+    static std::size_t CooldownSlot(NPCHandle handle, DialogueFunction fn)
     {
-        CooldownKey key{ profile.npcId, fn };
-        auto it = lastFireTimestamps.find(key);
-        float cooldown = 0.0f;
-        auto jt = profile.cooldownSeconds.find(fn);
-        if (jt != profile.cooldownSeconds.end())
-            cooldown = jt->second;
+        return handle.index * kDialogueFunctionCount + static_cast<std::size_t>(fn);
+    }
 
-        if (cooldown <= 0.0f)
-            return true;
+    bool CanFire(const NPCRecord& npc, DialogueFunction fn) const
+    {
+        return currentTimeSeconds >= npcReadyAtSeconds[CooldownSlot(npc.handle, fn)];
+    }
 
-        if (it == lastFireTimestamps.end())
-            return true;
+    void TouchCooldown(NPCRecord& npc, DialogueFunction fn)
+    {
+        const std::size_t slot = CooldownSlot(npc.handle, fn);
+        if (npcCooldownSeconds[slot] <= 0.0f)
+        {
+            npcReadyAtSeconds[slot] = currentTimeSeconds;
+            return;
+        }
 
-        double lastTime = it->second;
-        if (currentTimeSeconds - lastTime >= cooldown)
-            return true;
+        npcReadyAtSeconds[slot] = currentTimeSeconds + npcCooldownSeconds[slot];
+        MarkNotReady(npc.handle, fn);
+        // Payload: generation (24 bits) | slot index | function.
+        cooldownWheel.Schedule((static_cast<uint64_t>(npc.handle.generation & kTimerGenerationMask) << 40) |
+                               (static_cast<uint64_t>(npc.handle.index) << 8) |
+                               static_cast<uint64_t>(fn),
+                               npcReadyAtSeconds[slot]);
+    }
 
-        return false;
+    void MarkReady(NPCHandle handle, DialogueFunction fn)
+    {
+        uint32_t& pos = readyPos[CooldownSlot(handle, fn)];
+        if (pos != kNotReady)
+            return;
+        std::vector<NPCHandle>& list = readyNPCs[static_cast<std::size_t>(fn)];
+        pos = static_cast<uint32_t>(list.size());
+        list.push_back(handle);
     }
 
-    void TouchCooldown(const std::string& npcId, DialogueFunction fn)
+    void MarkNotReady(NPCHandle handle, DialogueFunction fn)
     {
-        CooldownKey key{ npcId, fn };
-        lastFireTimestamps[key] = currentTimeSeconds;
+        uint32_t& pos = readyPos[CooldownSlot(handle, fn)];
+        if (pos == kNotReady)
+            return;
+        std::vector<NPCHandle>& list = readyNPCs[static_cast<std::size_t>(fn)];
+        const NPCHandle moved = list.back();
+        list[pos] = moved;
+        readyPos[CooldownSlot(moved, fn)] = pos;
+        list.pop_back();
+        pos = kNotReady;
     }
 
     // --------------------------------------------------
     // Candidate collection
     // --------------------------------------------------
-    void CollectCandidates(const DialogueContext& ctx,
-                           const NPCVoiceProfile& profile,
+    void CollectCandidates(const PackedDialogueContext& ctx,
+                           const NPCRecord& npc,
                            DialogueFunction fn,
                            std::vector<const DialogueTemplate*>& out) const
     {
         out.clear();
+        ForEachCandidate(ctx, npc, fn, [&out](const DialogueTemplate& t) { out.push_back(&t); });
 
-        for (const auto& t : templates)
-        {
-            if (t.function != fn)
-                continue;
+        // If no candidates and function is not Threat/Pain, GenerateLine
+        // callers can pass a FallbackLadder (e.g. -> NeutralAmbient).
+    }
 
-            // Region filter (soft: allow mismatch with lower weight if needed)
-            if (t.regionTone != ctx.regionTone && t.regionTone != RegionTone::ForestVillage && ctx.regionTone != RegionTone::ForestVillage)
-                continue;
+    // Calls visit(const DialogueTemplate&) for every template of `fn`
+    // that passes all filters for this NPC and context.
+    template <typename Visitor>
+    void ForEachCandidate(const PackedDialogueContext& ctx,
+                          const NPCRecord& npc,
+                          DialogueFunction fn,
+                          Visitor&& visit) const
+    {
+        const uint32_t locationId = ctx.locationId;
+        const std::vector<uint32_t>& bucket = npc.eligibility->Bucket(fn, ctx.regionTone).indices;
 
-            // Role filter
-            if (!t.allowedRoles.empty())
+        if (const RegionLiveState* region = FindRegion(ctx.regionId))
+        {
+            // Taboos/events are resolved by the region's live sets. Walk
+            // whichever of the live set and the static bucket is smaller.
+            const std::vector<uint32_t>& live = region->live[static_cast<std::size_t>(fn)];
+            if (live.size() < bucket.size())
             {
-                bool roleOk = false;
-                for (auto r : t.allowedRoles)
+                const uint8_t roleBit = static_cast<uint8_t>(1u << static_cast<unsigned>(npc.voice->role));
+                for (uint32_t index : live)
                 {
-                    if (r == profile.role)
-                    {
-                        roleOk = true;
-                        break;
-                    }
+                    if (!(compiledTemplates[index].roleMask & roleBit) ||
+                        !PassesRegionFilter(templates[index], ctx.regionTone))
+                        continue;
+                    if (PassesContextPredicates(index, locationId, ctx, npc))
+                        visit(templates[index]);
                 }
-                if (!roleOk) continue;
             }
-
-            // Required taboos
-            bool taboosOk = true;
-            for (const auto& tb : t.requiredTabooIds)
+            else
             {
-                if (ctx.activeTabooIds.find(tb) == ctx.activeTabooIds.end())
+                for (uint32_t index : bucket)
                 {
-                    taboosOk = false;
-                    break;
+                    if (region->missing[index] != 0)
+                        continue;
+                    if (PassesContextPredicates(index, locationId, ctx, npc))
+                        visit(templates[index]);
                 }
             }
-            if (!taboosOk) continue;
+            return;
+        }
+
+        // Function, role and region are already resolved by the NPC's
+        // static eligibility; only context-dependent predicates remain.
+        // Required taboos and events: both sides are sorted ID lists.
+        for (uint32_t index : bucket)
+        {
+            const CompiledTemplate& c = compiledTemplates[index];
+            if (!std::includes(ctx.tabooIds.begin(), ctx.tabooIds.end(), c.tabooIds.begin(), c.tabooIds.end()) ||
+                !std::includes(ctx.eventIds.begin(), ctx.eventIds.end(), c.eventIds.begin(), c.eventIds.end()))
+                continue;
 
-            // Required events
-            bool eventsOk = true;
-            for (const auto& ev : t.requiredEventIds)
+            if (PassesContextPredicates(index, locationId, ctx, npc))
+                visit(templates[index]);
+        }
+    }
+
+    // Location blacklist + custom condition.
+    bool PassesContextPredicates(uint32_t index,
+                                 uint32_t locationId,
+                                 const PackedDialogueContext& ctx,
+                                 const NPCRecord& npc) const
+    {
+        if (IsLocationBlocked(index, locationId))
+            return false;
+
+        const DialogueTemplate& t = templates[index];
+        return !t.condition || t.condition(DialogueConditionContext{ ctx, *npc.voice, contextIds });
+    }
+
+    // --------------------------------------------------
+    // Weighted selection
+    // --------------------------------------------------
+    // Static buckets sample in O(1) from their alias table, or in O(log n)
+    // from a Fenwick tree once runtime weight scales apply (per-NPC tree
+    // first, then the bucket's global one). Buckets with context-dependent
+    // templates go through the configured linear path.
+    const DialogueTemplate* PickCandidate(const PackedDialogueContext& ctx,
+                                          NPCRecord& npc,
+                                          DialogueFunction fn,
+                                          std::vector<const DialogueTemplate*>& scratch,
+                                          RNG& rng)
+    {
+        EligibilityBucket& bucket = npc.eligibility->Bucket(fn, ctx.regionTone);
+        RefreshBucket(bucket);
+
+        if (bucket.isStatic)
+        {
+            if (bucket.indices.empty())
+                return nullptr;
+
+            const FenwickTree* tree = nullptr;
+            NPCBucketWeights* own = nullptr;
+            if (npc.weights)
+            {
+                auto it = npc.weights->buckets.find(&bucket);
+                if (it != npc.weights->buckets.end())
+                    own = &it->second;
+            }
+            if (own)
             {
-                if (ctx.recentEventIds.find(ev) == ctx.recentEventIds.end())
+                NPCBucketWeights& weights = *own;
+                if (weights.version != bucket.weightVersion)
                 {
-                    eventsOk = false;
-                    break;
+                    std::vector<float> effective;
+                    effective.reserve(bucket.indices.size());
+                    for (uint32_t index : bucket.indices)
+                        effective.push_back(EffectiveWeight(index, npc));
+                    weights.tree.Build(effective);
+                    weights.version = bucket.weightVersion;
                 }
+                tree = &weights.tree;
+            }
+            else if (bucket.modulated)
+            {
+                tree = &bucket.weighted;
             }
-            if (!eventsOk) continue;
 
-            // Location blacklist
-            if (!ctx.locationId.empty())
+            // Recent picks are accepted with probability recentWeightScale
+            // (exact rejection sampling); after a few misses fall back to
+            // the linear pass, which applies the same penalty directly.
+            for (int attempt = 0; attempt < kMaxRecencyRejections; ++attempt)
             {
-                bool locationBlocked = false;
-                for (const auto& loc : t.disallowedLocationIds)
-                {
-                    if (loc == ctx.locationId)
-                    {
-                        locationBlocked = true;
-                        break;
-                    }
-                }
-                if (locationBlocked) continue;
+                const double u = rng.RandomUnit();
+                const uint32_t index = bucket.indices[tree ? tree->Sample(u) : bucket.alias.Sample(u)];
+                if (!IsRecent(index, npc))
+                    return &templates[index];
+                if (recencyPolicy.recentWeightScale > 0.0f && rng.Chance(recencyPolicy.recentWeightScale))
+                    return &templates[index];
             }
+            return PickCandidateStreaming(ctx, npc, fn, rng);
+        }
 
-            // Custom condition
-            if (t.condition && !t.condition(ctx, profile))
-                continue;
+        if (samplingMode == SamplingMode::Streaming)
+            return PickCandidateStreaming(ctx, npc, fn, rng);
 
-            out.push_back(&t);
-        }
+        CollectCandidates(ctx, npc, fn, scratch);
+        return PickTemplateWeighted(scratch, npc, rng);
+    }
+
+    // Efraimidis–Spirakis (A-Res, reservoir of one) in the same pass as
+    // filtering: keep the candidate maximizing log(u) / weight, which is
+    // chosen with probability weight / totalWeight. Like the cumulative
+    // roll, non-positive weights only win when every candidate has one.
+    const DialogueTemplate* PickCandidateStreaming(const PackedDialogueContext& ctx,
+                                                   const NPCRecord& npc,
+                                                   DialogueFunction fn,
+                                                   RNG& rng)
+    {
+        const DialogueTemplate* first = nullptr;
+        const DialogueTemplate* best = nullptr;
+        double bestKey = 0.0;
+
+        ForEachCandidate(ctx, npc, fn, [&](const DialogueTemplate& t)
+        {
+            if (!first)
+                first = &t;
+            const float weight = SampleWeight(IndexOf(t), npc);
+            if (weight <= 0.0f)
+                return;
+
+            const double key = std::log(rng.RandomUnitOpenLow()) / weight;
+            if (!best || key > bestKey)
+            {
+                best = &t;
+                bestKey = key;
+            }
+        });
 
-        // If no candidates and function is not Threat/Pain, you may decide to
-        // fall back to NeutralAmbient in calling code.
+        return best ? best : first;
     }
 
-    // --------------------------------------------------
-    // Weighted selection
-    // --------------------------------------------------
-    const DialogueTemplate* PickTemplateWeighted(const std::vector<const DialogueTemplate*>& candidates)
+    const DialogueTemplate* PickTemplateWeighted(const std::vector<const DialogueTemplate*>& candidates,
+                                                 const NPCRecord& npc,
+                                                 RNG& rng)
     {
         if (candidates.empty())
             return nullptr;
 
         float totalWeight = 0.0f;
         for (auto* t : candidates)
-            totalWeight += t->weight;
+            totalWeight += SampleWeight(IndexOf(*t), npc);
 
         if (totalWeight <= 0.0f)
             return candidates[0];
@@ -554,7 +5196,7 @@ private:
 
         for (auto* t : candidates)
         {
-            cumulative += t->weight;
+            cumulative += SampleWeight(IndexOf(*t), npc);
             if (roll <= cumulative)
                 return t;
         }
@@ -564,37 +5206,113 @@ private:
     // --------------------------------------------------
     // Template realization: token replacement + style
     // --------------------------------------------------
-    std::string RealizeTemplate(const DialogueTemplate& t,
-                                const DialogueContext& ctx,
-                                const NPCVoiceProfile& profile)
+    void RegisterDefaultTokenResolvers()
+    {
+        RegisterTokenResolver("PLAYER_CALLSIGN", [](const TokenResolveContext& rc) { return PickPlayerCallsign(rc.profile); });
+        RegisterTokenResolver("LOCAL_SPIRIT",    [](const TokenResolveContext& rc) { return PickLocalSpiritEpithet(rc.ctx); });
+        RegisterTokenResolver("TABOO",           [](const TokenResolveContext& rc) { return PickTabooPhrase(rc.ctx, rc.ids); });
+        RegisterTokenResolver("PLACE",           [](const TokenResolveContext& rc) { return PickPlaceName(rc.ctx, rc.ids); });
+        RegisterTokenResolver("BODYSYMPTOM",     [](const TokenResolveContext& rc) { return PickBodySymptom(rc.ctx); });
+    }
+
+    // Splits text into literal spans and registered "{NAME}" tokens.
+    // Unknown braces stay literal.
+    void TokenizeText(const std::string& text, CompiledTemplate& c) const
     {
-        std::string base = t.text;
+        c.segments.clear();
+        c.tokenSlots.clear();
 
-        // Basic token replacements. In production these would come from KG queries.[file:1]
-        ReplaceToken(base, "{PLAYER_CALLSIGN}", PickPlayerCallsign(profile));
-        ReplaceToken(base, "{LOCAL_SPIRIT}", PickLocalSpiritEpithet(ctx));
-        ReplaceToken(base, "{TABOO}", PickTabooPhrase(ctx));
-        ReplaceToken(base, "{PLACE}", PickPlaceName(ctx));
-        ReplaceToken(base, "{BODYSYMPTOM}", PickBodySymptom(ctx));
+        const std::string_view view(text);
+        std::size_t literalBegin = 0;
+        std::size_t pos = 0;
+        while ((pos = view.find('{', pos)) != std::string_view::npos)
+        {
+            const std::size_t close = view.find_first_of("{}", pos + 1);
+            if (close == std::string_view::npos)
+                break;
+            if (view[close] == '{')
+            {
+                pos = close;
+                continue;
+            }
+
+            auto slot = resolverSlotById.find(TokenId(view.substr(pos + 1, close - pos - 1)));
+            if (slot == resolverSlotById.end() ||
+                tokenResolvers[slot->second].name != view.substr(pos + 1, close - pos - 1))
+            {
+                pos = close + 1;
+                continue;
+            }
 
-        // Style pass: adjust punctuation and add micro‑tails based on sliders.
-        ApplyStyleNoise(base, profile, t.function);
+            auto local = std::find(c.tokenSlots.begin(), c.tokenSlots.end(), slot->second);
+            if (local == c.tokenSlots.end())
+            {
+                if (c.tokenSlots.size() == kMaxTemplateTokens)
+                {
+                    pos = close + 1;
+                    continue;
+                }
+                c.tokenSlots.push_back(slot->second);
+                local = c.tokenSlots.end() - 1;
+            }
 
-        return base;
+            if (pos > literalBegin)
+                c.segments.push_back({ static_cast<uint32_t>(literalBegin), static_cast<uint32_t>(pos - literalBegin), TextSegment::kLiteral });
+            c.segments.push_back({ 0, 0, static_cast<uint8_t>(local - c.tokenSlots.begin()) });
+            pos = close + 1;
+            literalBegin = pos;
+        }
+        if (literalBegin < view.size())
+            c.segments.push_back({ static_cast<uint32_t>(literalBegin), static_cast<uint32_t>(view.size() - literalBegin), TextSegment::kLiteral });
     }
 
-    void ReplaceToken(std::string& text, const std::string& token, const std::string& value)
+    void RealizeTemplate(const DialogueTemplate& t,
+                         const PackedDialogueContext& ctx,
+                         const NPCVoiceProfile& profile,
+                         RNG& rng,
+                         LineBuffer& line)
     {
-        if (token.empty()) return;
-        std::size_t pos = 0;
-        while ((pos = text.find(token, pos)) != std::string::npos)
+        const CompiledTemplate& c = compiledTemplates[IndexOf(t)];
+
+        // Style pass: every random decision for the line comes from one draw.
+        StylePlan plan;
+        StyleDraw draw(rng.NextU64());
+        for (StylePass pass : stylePasses)
+            pass(profile, t.function, draw, plan);
+
+        for (std::size_t i = 0; i < plan.count; ++i)
+        {
+            if (plan.edits[i].kind == StyleEditKind::Prefix)
+                line.Append(plan.edits[i].text);
+        }
+        const std::size_t bodyBegin = line.Size();
+
+        // Write spans straight into the output, resolving each token present
+        // once through the flat resolver table. In production the values
+        // would come from KG queries.[file:1]
+        std::array<std::string_view, kMaxTemplateTokens> values;
+        uint32_t resolved = 0;
+        const std::string_view text(t.text);
+        for (const TextSegment& seg : c.segments)
         {
-            text.replace(pos, token.length(), value);
-            pos += value.length();
+            if (seg.token == TextSegment::kLiteral)
+            {
+                line.Append(text.substr(seg.begin, seg.length));
+                continue;
+            }
+            if (!(resolved & (1u << seg.token)))
+            {
+                const TokenResolverEntry& entry = tokenResolvers[c.tokenSlots[seg.token]];
+                values[seg.token] = entry.resolver(TokenResolveContext{ ctx, profile, entry.userData, contextIds });
+                resolved |= 1u << seg.token;
+            }
+            line.Append(values[seg.token]);
         }
+
+        ApplyStylePlan(plan, line, bodyBegin);
     }
 
-    std::string PickPlayerCallsign(const NPCVoiceProfile& profile)
+    static std::string_view PickPlayerCallsign(const NPCVoiceProfile& profile)
     {
         // Simple example – in Cell you can base this on reputation, faction, etc.[file:1]
         switch (profile.role)
@@ -606,7 +5324,7 @@ private:
         }
     }
 
-    std::string PickLocalSpiritEpithet(const DialogueContext& ctx)
+    static std::string_view PickLocalSpiritEpithet(const PackedDialogueContext& ctx)
     {
         // For demo: tie to region tone.[file:1]
         switch (ctx.regionTone)
@@ -619,13 +5337,13 @@ private:
         return "it";
     }
 
-    std::string PickTabooPhrase(const DialogueContext& ctx)
+    static std::string_view PickTabooPhrase(const PackedDialogueContext& ctx, const IdInterner& ids)
     {
-        if (ctx.activeTabooIds.empty())
+        if (ctx.tabooIds.empty())
             return "the old rules";
 
         // Take one arbitrary taboo ID and map to short phrase.[file:1]
-        const std::string& anyId = *ctx.activeTabooIds.begin();
+        const std::string& anyId = ids.Name(*ctx.tabooIds.begin());
         if (anyId == "TABS_WHISTLE_AT_NIGHT")
             return "no whistling after dark";
         if (anyId == "TABS_NO_BUCKETS_UPSIDE_DOWN")
@@ -634,74 +5352,115 @@ private:
         return "the village law";
     }
 
-    std::string PickPlaceName(const DialogueContext& ctx)
+    static std::string_view PickPlaceName(const PackedDialogueContext& ctx, const IdInterner& ids)
     {
-        if (ctx.locationId.find("ASHDITCH") != std::string::npos)
+        if (ctx.locationId == IdInterner::kInvalid)
+            return "this place";
+
+        const std::string& locationId = ids.Name(ctx.locationId);
+        if (locationId.find("ASHDITCH") != std::string::npos)
             return "Ash Ditch";
-        if (ctx.locationId.find("BLOCK_A") != std::string::npos)
+        if (locationId.find("BLOCK_A") != std::string::npos)
             return "Block A stairwell";
 
         return "this place";
     }
 
-    std::string PickBodySymptom(const DialogueContext& ctx)
+    static std::string_view PickBodySymptom(const PackedDialogueContext& ctx)
     {
-        if (ctx.playerIsBleeding)
+        if (ctx.Has(PackedDialogueContext::PlayerIsBleeding))
             return "bleeding";
-        if (ctx.playerLowHealth)
+        if (ctx.Has(PackedDialogueContext::PlayerLowHealth))
             return "shaking";
         return "breathing";
     }
 
-    void ApplyStyleNoise(std::string& line,
-                         const NPCVoiceProfile& profile,
-                         DialogueFunction fn)
+    void RegisterDefaultStylePasses()
+    {
+        AddStylePass(&StyleTerseCut);
+        AddStylePass(&StyleFatalistTail);
+        AddStylePass(&StyleBureaucraticPreamble);
+        AddStylePass(&StyleSuperstitiousTrailOff);
+    }
+
+    // Shorten or slightly fragment lines when verbosity is low.[file:1]
+    static void StyleTerseCut(const NPCVoiceProfile& profile, DialogueFunction, StyleDraw& draw, StylePlan& plan)
     {
-        // Shorten or slightly fragment lines when verbosity is low.[file:1]
         if (profile.verbosity01 < 0.3f)
-        {
-            if (line.size() > 60)
-            {
-                // Cut at the last space before 60 and add ellipsis occasionally.
-                std::size_t cutPos = line.rfind(' ', 60);
-                if (cutPos != std::string::npos)
-                {
-                    line.erase(cutPos);
-                    if (rng.Chance(0.5f))
-                        line += "...";
-                }
-            }
-        }
+            plan.Add(StyleEditKind::TruncateBody, draw.Chance(0.5f) ? "..." : "", 60);
+    }
 
-        // Add resigned tails for high fatalism.
-        if (profile.fatalism01 > 0.6f && rng.Chance(0.4f))
+    // Add resigned tails for high fatalism.
+    static void StyleFatalistTail(const NPCVoiceProfile& profile, DialogueFunction fn, StyleDraw& draw, StylePlan& plan)
+    {
+        if (profile.fatalism01 > 0.6f && draw.Chance(0.4f))
         {
             if (fn == DialogueFunction::Dread || fn == DialogueFunction::Rumor)
             {
-                static const std::vector<std::string> tails = {
+                static constexpr std::array<std::string_view, 4> tails = {
                     " You get used to it.",
                     " It was worse before.",
                     " It never really stops.",
                     " That's just how it is here."
                 };
-                int idx = rng.RandomInt(0, static_cast<int>(tails.size()) - 1);
-                line += tails[idx];
+                plan.Add(StyleEditKind::Suffix, tails[draw.Pick(static_cast<uint32_t>(tails.size()))]);
             }
         }
+    }
 
-        // Add bureaucratic flavor.
+    // Add bureaucratic flavor.
+    static void StyleBureaucraticPreamble(const NPCVoiceProfile& profile, DialogueFunction fn, StyleDraw& draw, StylePlan& plan)
+    {
         if (profile.bureaucratic01 > 0.5f && fn == DialogueFunction::Bureaucratic)
         {
-            if (rng.Chance(0.5f))
-                line = "According to regulations, " + line;
+            if (draw.Chance(0.5f))
+                plan.Add(StyleEditKind::Prefix, "According to regulations, ");
+        }
+    }
+
+    // Very small chance of fragmented syntax for high superstition.
+    static void StyleSuperstitiousTrailOff(const NPCVoiceProfile& profile, DialogueFunction, StyleDraw& draw, StylePlan& plan)
+    {
+        if (profile.superstition01 > 0.7f && draw.Chance(0.35f))
+        {
+            plan.Add(StyleEditKind::SoftenFinalStop);
+            plan.Add(StyleEditKind::Suffix, "Just... don't ask.");
+        }
+    }
+
+    // Prefixes are already written; cut the body span once, then write the
+    // suffix edits in order.
+    static void ApplyStylePlan(const StylePlan& plan, LineBuffer& line, std::size_t bodyBegin)
+    {
+        std::size_t bodyEnd = line.Size();
+        std::string_view cutMarker;
+        bool cut = false;
+        for (std::size_t i = 0; i < plan.count; ++i)
+        {
+            const StyleEdit& e = plan.edits[i];
+            if (e.kind != StyleEditKind::TruncateBody || bodyEnd - bodyBegin <= e.limit)
+                continue;
+
+            // Prefer the last space before the limit; otherwise stop short of
+            // a split UTF-8 sequence.
+            std::size_t cutPos = line.RFind(' ', bodyBegin + e.limit);
+            if (cutPos == std::string_view::npos || cutPos <= bodyBegin)
+                cutPos = line.Utf8Floor(bodyBegin + e.limit);
+            bodyEnd = cutPos;
+            cutMarker = e.text;
+            cut = true;
         }
+        line.Truncate(bodyEnd);
+        if (cut)
+            line.Append(cutMarker);
 
-        // Very small chance of fragmented syntax for high superstition.
-        if (profile.superstition01 > 0.7f && rng.Chance(0.35f))
+        for (std::size_t i = 0; i < plan.count; ++i)
         {
-            if (line.back() == '.')
-                line.back() = ' ';
-            line += "Just... don't ask.";
+            const StyleEdit& e = plan.edits[i];
+            if (e.kind == StyleEditKind::Suffix)
+                line.Append(e.text);
+            else if (e.kind == StyleEditKind::SoftenFinalStop && line.Size() > bodyBegin && line.Back() == '.')
+                line.Back() = ' ';
         }
     }
 };
@@ -760,6 +5519,18 @@ int main()
     if (!line2.empty())
         std::cout << oldNeighbor.displayName << ": " << line2 << "\n";
 
+    // Heartbeat again while Dread is cooling down: fall back down the ladder
+    timeSec += 2.0;
+    dlg.SetCurrentTimeSeconds(timeSec);
+    std::string line3 = dlg.GenerateLine("NPC_OLD_NEIGHBOR",
+                                         "on_night_heartbeat",
+                                         ctx,
+                                         FallbackLadder()
+                                             .Then(DialogueFunction::Rumor)
+                                             .Then(DialogueFunction::Misdirection));
+    if (!line3.empty())
+        std::cout << oldNeighbor.displayName << ": " << line3 << "\n";
+
     return 0;
 }
 #endif
@@ -0,0 +1,84 @@
+// src/narrative/bench/RealizeBenchmark.cpp
+//
+// Realization latency for a token-heavy template: seven token occurrences
+// (plus one unknown brace) in a ~150 character line. Realization alone is
+// timed by realizing one deferred line repeatedly; the second figure is a
+// full GenerateLine (trigger mapping, selection and realization).
+//
+//   g++ -std=c++17 -O2 -pthread RealizeBenchmark.cpp -o realize_bench && ./realize_bench [iterations]
+
+#include "../DialogueSystem.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char** argv)
+{
+    const std::size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    DialogueSystem system;
+    system.SetSessionSeed(1);
+
+    NPCVoiceProfile profile;
+    profile.npcId = "BENCH_NPC";
+    profile.superstition01 = 0.0f;
+    profile.fatalism01 = 0.0f;
+    profile.role = SpeakerSocialRole::Soldier;
+    profile.cooldownSeconds.fill(0.0f);
+    const NPCHandle npc = system.RegisterNPCProfile(profile);
+
+    DialogueTemplate t;
+    t.id = "BENCH_TOKENS";
+    t.function = DialogueFunction::Rumor;
+    t.text = "{PLAYER_CALLSIGN}, {LOCAL_SPIRIT} walks {PLACE} again; mind {TABOO}, {PLAYER_CALLSIGN}, "
+             "you are {BODYSYMPTOM} {UNKNOWN} and {PLACE} waits.";
+    system.AddTemplate(t);
+    system.SetTriggerRules("bench", { TriggerRule{ TriggerRule::Input::Always,
+                                                   TriggerRule::Compare::Greater,
+                                                   0.0f, DialogueFunction::Rumor } });
+    const TriggerId trigger = system.FindTrigger("bench");
+
+    DialogueContext ctx;
+    ctx.locationId = "PLC_VILLAGE_ASHDITCH";
+    ctx.activeTabooIds.insert("TABS_WHISTLE_AT_NIGHT");
+    ctx.playerIsBleeding = true;
+    system.DeclareContextIds({ ctx.locationId });
+
+    char buffer[512];
+    std::size_t bytes = 0;
+    using Clock = std::chrono::steady_clock;
+
+    const ContextSnapshotId snapshot = system.SnapshotContext(ctx);
+    const DeferredDialogueLine line = system.GenerateLineDeferred(npc, trigger, snapshot);
+    if (!line)
+    {
+        std::printf("no line selected\n");
+        return 1;
+    }
+
+    const Clock::time_point realizeStart = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        bytes += system.RealizeDeferred(line, buffer, sizeof(buffer)).text.size();
+    const Clock::time_point realizeEnd = Clock::now();
+
+    const PackedDialogueContext packed = system.PackContext(ctx);
+    DialogueLineResult last;
+    const Clock::time_point generateStart = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        system.SetCurrentTimeSeconds(static_cast<double>(i));
+        last = system.GenerateLine(npc, trigger, packed, buffer, sizeof(buffer));
+        bytes += last.text.size();
+    }
+    const Clock::time_point generateEnd = Clock::now();
+
+    const auto perCall = [iterations](Clock::time_point a, Clock::time_point b)
+    {
+        return std::chrono::duration<double, std::nano>(b - a).count() / static_cast<double>(iterations);
+    };
+    std::printf("%.*s\n", static_cast<int>(last.text.size()), last.text.data());
+    std::printf("realize:      %8.1f ns/line\n", perCall(realizeStart, realizeEnd));
+    std::printf("GenerateLine: %8.1f ns/line\n", perCall(generateStart, generateEnd));
+    std::printf("(%zu bytes written)\n", bytes);
+    return 0;
+}
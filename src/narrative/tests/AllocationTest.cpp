@@ -0,0 +1,180 @@
+// src/narrative/tests/AllocationTest.cpp
+//
+// Checks that the buffer and arena forms of GenerateLine, and realizing a
+// deferred line, do not touch the heap once warmed up, including for
+// contexts with long ID lists and names the system does not know. Global operator new
+// is replaced with a counting version for the whole program.
+//
+//   g++ -std=c++17 -O2 -pthread AllocationTest.cpp -o allocation_test && ./allocation_test
+//
+// Exits non-zero on failure.
+
+#include "../DialogueSystem.cpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<std::size_t> allocationCount{ 0 };
+
+    // Out of line so GCC does not pair the inlined free() with the
+    // operator new call at each delete site (-Wmismatched-new-delete).
+    [[gnu::noinline]] void Release(void* p) noexcept
+    {
+        std::free(p);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept { Release(p); }
+void operator delete[](void* p) noexcept { Release(p); }
+void operator delete(void* p, std::size_t) noexcept { Release(p); }
+void operator delete[](void* p, std::size_t) noexcept { Release(p); }
+
+namespace
+{
+    constexpr std::size_t kWarmupCalls = 2000;
+    constexpr std::size_t kMeasuredCalls = 20000;
+
+    // Runs `call` for a warm-up pass, then counts allocations over a
+    // second pass. `lines` counts non-empty results so a test that never
+    // produces text does not pass vacuously.
+    template <typename Call>
+    bool ExpectNoAllocations(const char* name, Call call)
+    {
+        std::size_t lines = 0;
+        for (std::size_t i = 0; i < kWarmupCalls; ++i)
+            lines += call(i) ? 1 : 0;
+
+        const std::size_t before = allocationCount.load();
+        for (std::size_t i = kWarmupCalls; i < kWarmupCalls + kMeasuredCalls; ++i)
+            lines += call(i) ? 1 : 0;
+        const std::size_t allocations = allocationCount.load() - before;
+
+        const bool ok = allocations == 0 && lines > 0;
+        std::printf("%s %s: %zu allocations over %zu calls (%zu lines)\n",
+                    ok ? "ok  " : "FAIL", name, allocations, kMeasuredCalls, lines);
+        return ok;
+    }
+}
+
+int main()
+{
+    DialogueSystem system;
+    system.SetSessionSeed(11);
+
+    const char* npcIds[] = { "ALLOC_SOLDIER", "ALLOC_PRIEST", "ALLOC_HERMIT" };
+    const SpeakerSocialRole roles[] = { SpeakerSocialRole::Soldier, SpeakerSocialRole::Priest,
+                                        SpeakerSocialRole::Hermit };
+    std::vector<NPCHandle> npcs;
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        NPCVoiceProfile profile;
+        profile.npcId = npcIds[i];
+        profile.role = roles[i];
+        profile.cooldownSeconds.fill(0.0f);
+        npcs.push_back(system.RegisterNPCProfile(profile));
+    }
+
+    DialogueContext ctx;
+    ctx.locationId = "PLC_VILLAGE_ASHDITCH";
+    ctx.threatLevel01 = 0.7f;
+    ctx.isNight = true;
+    ctx.playerIsBleeding = true;
+    ctx.activeTabooIds.insert("TABS_WHISTLE_AT_NIGHT");
+    ctx.recentEventIds.insert("EVT_BELL_AT_MIDNIGHT");
+    system.DeclareContextIds({ ctx.locationId, "EVT_BELL_AT_MIDNIGHT" });
+
+    // Lists longer than PackedIdList::kInline, plus names the system
+    // never saw, which packing drops without interning them.
+    DialogueContext crowded = ctx;
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+        const std::string n = std::to_string(i);
+        system.DeclareContextIds({ "TABS_ALLOC_" + n, "EVT_ALLOC_" + n, "RUM_ALLOC_" + n });
+        crowded.activeTabooIds.insert("TABS_ALLOC_" + n);
+        crowded.recentEventIds.insert("EVT_ALLOC_" + n);
+        crowded.knownRumorIds.insert("RUM_ALLOC_" + n);
+        crowded.knownRumorIds.insert("RUM_UNDECLARED_" + n);
+        crowded.activeTabooIds.insert("TABS_UNDECLARED_" + n);
+    }
+
+    // Six templates per function keep the per-NPC recency window from
+    // emptying a bucket; each carries tokens so realization does real work.
+    const DialogueFunction functions[] = { DialogueFunction::Dread, DialogueFunction::Rumor,
+                                           DialogueFunction::ThreatBark };
+    const std::string triggers[] = { "alloc_dread", "alloc_rumor", "alloc_threat" };
+    std::vector<TriggerId> triggerIds;
+    for (std::size_t f = 0; f < 3; ++f)
+    {
+        for (std::size_t i = 0; i < 6; ++i)
+        {
+            DialogueTemplate t;
+            t.id = triggers[f] + "_" + std::to_string(i);
+            t.function = functions[f];
+            t.text = "{PLAYER_CALLSIGN}, mind {TABOO} near {PLACE}; line " + std::to_string(i) + ".";
+            system.AddTemplate(t);
+        }
+        system.SetTriggerRules(triggers[f], { TriggerRule{ TriggerRule::Input::Always,
+                                                           TriggerRule::Compare::Greater,
+                                                           0.0f, functions[f] } });
+        triggerIds.push_back(system.FindTrigger(triggers[f]));
+    }
+
+    const PackedDialogueContext packed = system.PackContext(ctx);
+    char buffer[512];
+    double now = 0.0;
+    bool ok = true;
+
+    ok = ExpectNoAllocations("string ids, caller buffer", [&](std::size_t i)
+    {
+        system.SetCurrentTimeSeconds(now += 1.0);
+        return !system.GenerateLine(npcIds[i % 3], triggers[i % 3], ctx, buffer, sizeof(buffer)).text.empty();
+    }) && ok;
+
+    ok = ExpectNoAllocations("string ids, long id lists", [&](std::size_t i)
+    {
+        system.SetCurrentTimeSeconds(now += 1.0);
+        return !system.GenerateLine(npcIds[i % 3], triggers[i % 3], crowded, buffer, sizeof(buffer)).text.empty();
+    }) && ok;
+
+    DialogueLineArena& arena = DialogueLineArena::ForCurrentThread();
+    ok = ExpectNoAllocations("string ids, thread arena", [&](std::size_t i)
+    {
+        system.SetCurrentTimeSeconds(now += 1.0);
+        return !system.GenerateLine(npcIds[i % 3], triggers[i % 3], ctx, arena).text.empty();
+    }) && ok;
+
+    ok = ExpectNoAllocations("handles, packed context", [&](std::size_t i)
+    {
+        system.SetCurrentTimeSeconds(now += 1.0);
+        return !system.GenerateLine(npcs[i % 3], triggerIds[i % 3], packed, buffer, sizeof(buffer)).text.empty();
+    }) && ok;
+
+    const ContextSnapshotId snapshot = system.SnapshotContext(ctx);
+    std::vector<DeferredDialogueLine> deferred;
+    for (std::size_t i = 0; i < 3; ++i)
+        deferred.push_back(system.GenerateLineDeferred(npcs[i], triggerIds[i], snapshot));
+    ok = ExpectNoAllocations("deferred realize", [&](std::size_t i)
+    {
+        return !system.RealizeDeferred(deferred[i % 3], buffer, sizeof(buffer)).text.empty();
+    }) && ok;
+
+    std::printf(ok ? "PASS\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// src/narrative/tests/SamplerDistributionTest.cpp
+//
+// Checks that the alias table, the Fenwick tree and GenerateLine's static
+// bucket path draw templates in proportion to their configured weights.
+//
+//   g++ -std=c++17 -O2 -pthread SamplerDistributionTest.cpp -o sampler_test && ./sampler_test
+//
+// Exits non-zero on failure. Draws come from a fixed RNG stream, so the
+// result is deterministic.
+
+#include "../DialogueSystem.cpp"
+
+#include <cstdio>
+
+namespace
+{
+    constexpr std::size_t kDraws = 200000;
+
+    // Upper 99.9% quantile of chi-square with `dof` degrees of freedom
+    // (Wilson–Hilferty).
+    double ChiSquareCritical(std::size_t dof)
+    {
+        const double k = static_cast<double>(dof);
+        const double z = 3.09;
+        const double t = 1.0 - 2.0 / (9.0 * k) + z * std::sqrt(2.0 / (9.0 * k));
+        return k * t * t * t;
+    }
+
+    // Compares observed counts against `weights`. Zero-weight slots must
+    // never be drawn; the others go into the chi-square statistic.
+    bool CheckDistribution(const char* name,
+                           const std::vector<float>& weights,
+                           const std::vector<std::size_t>& counts)
+    {
+        double total = 0.0;
+        for (float w : weights)
+            total += w > 0.0f ? w : 0.0f;
+
+        std::size_t draws = 0;
+        for (std::size_t c : counts)
+            draws += c;
+
+        double chi2 = 0.0;
+        std::size_t categories = 0;
+        for (std::size_t i = 0; i < weights.size(); ++i)
+        {
+            if (weights[i] <= 0.0f)
+            {
+                if (counts[i] != 0)
+                {
+                    std::printf("FAIL %s: zero-weight slot %zu drawn %zu times\n", name, i, counts[i]);
+                    return false;
+                }
+                continue;
+            }
+            const double expected = draws * weights[i] / total;
+            const double diff = static_cast<double>(counts[i]) - expected;
+            chi2 += diff * diff / expected;
+            ++categories;
+        }
+
+        const double critical = categories > 1 ? ChiSquareCritical(categories - 1) : 0.0;
+        const bool ok = categories <= 1 || chi2 <= critical;
+        std::printf("%s %s: chi2 %.2f (critical %.2f, %zu slots)\n",
+                    ok ? "ok  " : "FAIL", name, chi2, critical, categories);
+        return ok;
+    }
+
+    bool TestAliasTable(const char* name, const std::vector<float>& weights)
+    {
+        AliasTable table;
+        table.Build(weights);
+        RNG rng(StableHash64(name));
+        std::vector<std::size_t> counts(weights.size(), 0);
+        for (std::size_t i = 0; i < kDraws; ++i)
+            ++counts[table.Sample(rng.RandomUnit())];
+        return CheckDistribution(name, weights, counts);
+    }
+
+    bool TestFenwickTree(const char* name, std::vector<float> weights)
+    {
+        FenwickTree tree;
+        tree.Build(weights);
+        RNG rng(StableHash64(name));
+        std::vector<std::size_t> counts(weights.size(), 0);
+        for (std::size_t i = 0; i < kDraws; ++i)
+            ++counts[tree.Sample(rng.RandomUnit())];
+        bool ok = CheckDistribution(name, weights, counts);
+
+        // Point updates must move the distribution with them.
+        for (std::size_t i = 0; i < weights.size(); i += 2)
+        {
+            weights[i] = weights[i] * 3.0f + 0.25f;
+            tree.Set(i, weights[i]);
+        }
+        if (!weights.empty())
+        {
+            weights.back() = 0.0f;
+            tree.Set(weights.size() - 1, 0.0f);
+        }
+        std::fill(counts.begin(), counts.end(), 0);
+        for (std::size_t i = 0; i < kDraws; ++i)
+            ++counts[tree.Sample(rng.RandomUnit())];
+        const std::string updated = std::string(name) + " after Set";
+        return CheckDistribution(updated.c_str(), weights, counts) && ok;
+    }
+
+    // End to end: a static bucket sampled through GenerateLine, first via
+    // its alias table, then via the Fenwick tree once a weight scale applies.
+    bool TestGenerateLine()
+    {
+        DialogueSystem system;
+        system.SetSessionSeed(7);
+
+        RecencyPolicy noRecency;
+        noRecency.npcWindowPicks = 0;
+        noRecency.globalWindowPicks = 0;
+        system.SetRecencyPolicy(noRecency);
+
+        std::vector<float> weights = { 1.0f, 2.0f, 3.0f, 4.0f, 0.5f, 0.0f };
+        std::vector<std::string> ids;
+        for (std::size_t i = 0; i < weights.size(); ++i)
+        {
+            DialogueTemplate t;
+            t.id = "TEST_RUMOR_" + std::to_string(i);
+            t.function = DialogueFunction::Rumor;
+            t.text = "rumor " + std::to_string(i);
+            t.weight = weights[i];
+            system.AddTemplate(t);
+            ids.push_back(t.id);
+        }
+
+        NPCVoiceProfile profile;
+        profile.npcId = "TEST_NPC";
+        profile.cooldownSeconds.fill(0.0f);
+        const NPCHandle npc = system.RegisterNPCProfile(profile);
+
+        system.SetTriggerRules("test_rumor", { TriggerRule{ TriggerRule::Input::Always,
+                                                            TriggerRule::Compare::Greater,
+                                                            0.0f, DialogueFunction::Rumor } });
+        const TriggerId trigger = system.FindTrigger("test_rumor");
+        const PackedDialogueContext ctx = system.PackContext(DialogueContext());
+        double now = 0.0;
+
+        auto draw = [&](const char* name)
+        {
+            std::vector<std::size_t> counts(weights.size(), 0);
+            char buffer[256];
+            for (std::size_t i = 0; i < kDraws / 4; ++i)
+            {
+                system.SetCurrentTimeSeconds(now += 1.0);
+                const DialogueLineResult r = system.GenerateLine(npc, trigger, ctx, buffer, sizeof(buffer));
+                const auto it = std::find(ids.begin(), ids.end(), r.templateId);
+                if (it != ids.end())
+                    ++counts[it - ids.begin()];
+            }
+            return CheckDistribution(name, weights, counts);
+        };
+
+        bool ok = draw("GenerateLine alias");
+        system.SetTemplateWeightScale(ids[0], 4.0f);
+        weights[0] *= 4.0f;
+        ok = draw("GenerateLine fenwick") && ok;
+        return ok;
+    }
+}
+
+int main()
+{
+    bool ok = true;
+    ok = TestAliasTable("alias uniform", { 1.0f, 1.0f, 1.0f, 1.0f }) && ok;
+    ok = TestAliasTable("alias skewed", { 0.1f, 5.0f, 0.0f, 2.5f, 1.0f, 0.01f, 12.0f }) && ok;
+    ok = TestAliasTable("alias single", { 3.0f }) && ok;
+    ok = TestFenwickTree("fenwick skewed", { 0.1f, 5.0f, 0.0f, 2.5f, 1.0f, 0.01f, 12.0f }) && ok;
+    ok = TestFenwickTree("fenwick wide", std::vector<float>(37, 1.0f)) && ok;
+    ok = TestGenerateLine() && ok;
+
+    std::printf(ok ? "PASS\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}